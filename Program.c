@@ -1,12 +1,22 @@
 #include <stdio.h>
-#include <math.h>
 #include <stdlib.h>
 #include <time.h>
+#include <getopt.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "libspa.h"
 
 /************************************************************************************************************/
 /*                       User Guide                                                                         */   
 /*         *** Everything to change is located right beneath this guide                                     */                  
 /*  Data to input:                                                                                          */                     
+/*    Run as  ./spa.out [options] fileName1 fileName2  (with no files the two example files are used).      */
+/*    or as   ./spa.out [options] instance.spab  with the two files compiled into one by compile.out.       */
+/*    The options are listed in 'usage' below, e.g. --replicas 32 for parallel tempering on 32 cores, or    */
+/*    --chains 8 to anneal 8 independent chains and keep the best.                                          */
+/*    The number of projects, pairs and supervisors is worked out from the files.                           */
 /*      * fileName1 is the file with the project choices in. It can be produced by Excel.                   */
 /*	     Each column represents a pair of students, and each row a project. Values of 1 to 4 should be  */
 /*           filled in, representing the pairs preference. If the pair have not picked a project,           */
@@ -28,454 +38,370 @@
 /*           Should be a CSV file.                                                                          */
 /*                                                                                                          */
 /* Variables to change:                                                                                     */
-/*   * rows - this is the number of projects on offer (and hence the number of rows in both                 */
-/*            your fileName1 and fileName2.                                                                 */
-/*   * cols - this is the number of pairs who have chosen projects (and hence the number of                 */
-/*            columns in fileName1). Update the constant "#define cols as well.                                                                      */
-/*   * numLec - the number of supervisors (and hence the number of columns in fileName2).                   */
-/*   * weightings - 'weighti' is for preference i used in the function 'energy'. Needs to be integers.                           */
+/*   * cooling schedule - 'schedule' and the settings after it in spaDefaults (solver.c), or the options    */
+/*            --schedule, --tstart etc.                                                                     */
+/*   * weightings - 'score' is how much each preference is worth (out of 5). The weights used in the        */
+/*            function 'energy' are worked out from it in setWeights.                                       */
 /*                                                                                                          */
-/* When compiling in the terminal, compile this program with the random num generator file 'ranvec.c'       */
-/* and '-lm' for math library                                                                               */ 
+/* The solver itself is the library libspa.a (see libspa.h), and this file only reads the options and       */
+/* calls it. 'make' builds both, with '-lm' for the math library and '-pthread'.                            */
 /*                                                                                                          */
 /*  Output files:                                                                                           */
 /* The data saves to file 'finalConfig.txt' which contains the pair number, project number they are given   */
 /* and their preference for this project.                                                                   */
+/* How the annealing went is saved to 'newData.txt', one CSV line every logEvery temperatures: the level,   */
+/* temperature, current and best energy, the proposals, how many were accepted, rejected for a clash, on    */
+/* energy and for a supervisor's workload, and came to nothing, then the seconds since the start.           */
 /************************************************************************************************************/
 
 /*Variables to change */
-int rows = 58; /* NUMBER OF PROJECTS */
-int cols = 19; /* NUMBER OF PAIRS (some might be singletons) */
-#define cols 19
-int numLec = 27; /* NUMBER OF LECTURERS */
-char fileName1[] = "StudentExample.csv"; /* This file has the data to fill choices - is passed into readChoices */
-char fileName2[] = "SupervisorExample.csv"; /* This file has the data to fill in supConstraint - is passed into readLecturers */
-
-/*weightings*/
-/***THIS IS VERSION WITH 4.7, 4.15, 3, 2.3 (out of 5)**/
-float weight1 = (float)100/(float)cols;
-float weight2 = ((float)100/(float)cols) * ((float)4.15/(float)4.7);
-float weight3 = ((float)100/(float)cols) * ((float)3/(float)4.7);
-float weight4 = ((float)100/(float)cols) * ((float)2.35/(float)4.7);
-
-/*global variables*/
-double rands[100000]; /* home to random numbers */
-double temp = 5; /* starting temperature */
-
-
-float energy( int projPref[] ); /* calculates energy of a given allocation */
-int projClashFullCount(int projNum[]); /* counts clashes between allocations */
-void generateRandomNumbers(); //ranvec.c
-int randomNum( float random, int divisor ); /* turns a random number into modulo divisor so we can use it */
-void changeAllocationByPref( int choices[rows][cols], int projNum[cols], int projPref[cols], int changes[] ); /* changes allocation of ONE PAIRS project based on random choice of preference */
-void readChoices( int choices[rows][cols] ); /* reads in the choices file */
-void readLecturers( float supConstraint[rows][numLec] ); /* reads in the lecturer constraint file */
-int countViolations( int projNum[],float supConstraint[rows][numLec] ); /* counts violations of constraints */
-int countSupConstraintClashes( float supConstraint[rows][numLec], int projNum[], int proj); /*counts violations of lectuere constraint */
-void createInitialConfiguration( int choices[rows][cols], int projNum[cols], int projPref[cols], int changes[], float supConstraint[rows][numLec] ); /* does what it says */
-void cycleOfMoves( int choices[rows][cols], int projNum[cols], int projPref[cols], int changes[], float supConstraint[rows][numLec], FILE* saveData ); /* Does all the moves for a fixed temp.*/
-void init_vector_random_generator(int ,int);
-void vector_random_generator(int, double *);
+char *fileName1 = "StudentExample.csv"; /* This file has the data to fill choices - is passed into loadCsv. Replaced by the first command line argument */
+char *fileName2 = "SupervisorExample.csv"; /* This file has the data to fill in the supervisors - is passed into loadCsv. Replaced by the second */
+char *compiledFile = NULL; /* a compiled instance to map in instead of reading fileName1 and fileName2 (see instance.c). Set by giving one file */
+char *batchFile = NULL; /* a manifest of problems to solve in one go, instead of fileName1 and fileName2 (see batch.c). Set by --batch */
+char *socketPath = NULL; /* if set, run as a daemon taking solve requests on this socket (see daemon.c). Set by --serve */
+long int rngTest = 0; /* if > 0, just check the random number generators on this many numbers each (see philox.c). Set by --rng-test */
+int jobs = 0; /* how many of the batch, or of the daemon's requests, to solve at once. 0 is one per core. Set by --jobs */
+struct settings settings; /* everything else, from spaDefaults and then the options. See libspa.h */
+struct solver *running = NULL; /* the solver spaSolve is running, for stopRunning */
+
+void usage( char *program ); /* prints the options */
+void stopRunning( int signalNumber ); /* Ctrl-C or kill: finish early with the best allocation so far */
+int runBatch( char *manifest, int numWorkers, struct settings *settings ); /* solves every problem in the manifest. RETURNS 0 if they were all solved, else 1 */
+int runDaemon( char *socketPath, int numWorkers, struct settings *settings ); /* answers requests on the socket until told to shut down. RETURNS 0 if it could listen, else 1 */
 /* end of function initialisations */
 
-int main() {
-
-	int choices[rows][cols]; /* This has the choices the pair made in. We import it from csv file. */
-	float supConstraint[rows][numLec]; /* This has all the data needed for calculating supervisor constraints in - including which projects a supervisor has and how many they can supervise. Imported from csv file */
-	int i,j; 
-	int projNum[cols]; /* for each pair, stores what number project they are currently assigned */
-	int projPref[cols]; /* for each pair, stores what preference their currently assigned project is. NOTE the preference stored here is not zero-indexed. */
-	int changes[3]; /* 0 is PAIR, 1 is PROJECT, 2 is PREF */	
-	
-	FILE *finalConfig; /* this file saves the final configuration - which pair have what project */
-	FILE *saveData;
-
-	generateRandomNumbers(); 
-	
-	/* read in Data */
-	readChoices( choices);
-	readLecturers( supConstraint );
-	
-	createInitialConfiguration( choices, projNum, projPref, changes, supConstraint );
-	/* We have a starting configuration WITH NO VIOLATIONS. */
-	saveData = fopen("newData.txt", "w");
-	
-	/* Simulated Annealing time 
-	   So, we stay at one temperature until either 1000*cols moves or 100*cols Succesful Moves. 
-	   Then decrease and go again.	
-	*/
-	while ( temp >= 0 ) {
-		cycleOfMoves( choices, projNum, projPref, changes, supConstraint, saveData );
-		/* decrease temp */
-		temp=temp-0.001;
-	}
-	
-	printf("Final energy is %f\n", energy(projPref));
-	finalConfig = fopen("finalConfig.txt", "a");	
-	/* print final configuration to file */
-	for (i=0; i<cols; i++) {
-		fprintf(finalConfig, "%d,%d,%d\n", i+1, projNum[i]+1, projPref[i]);
-	}
-	fprintf(finalConfig, "Final energy: %f\n", energy(projPref) );
-	fclose(finalConfig);
-	fclose(saveData);
-
-	return 0;
-}
-
-void cycleOfMoves( int choices[rows][cols], int projNum[cols], int projPref[cols], int changes[], float supConstraint[rows][numLec], FILE* saveData ) {
-	int successfulmoves = 0;
-	int moves = 0;
-	int same = 0;
-	float trialEnergy, currentEnergy;
-	float changeEnergy, ratioEnergy;
-	int lecClashes;
-	
-	generateRandomNumbers(); 
-	currentEnergy = energy( projPref );
-	printf("Temperature %f\nCurrent Energy = %f\n\n", temp,currentEnergy);
-	while ( moves < ( 1000 * cols ) && successfulmoves < ( 100 * cols ) ) { 
-		moves++;
-		successfulmoves++; 
-		/* change the allocation here */
-		changeAllocationByPref( choices, projNum, projPref, changes );
-
-		//printf(" weight 1: %f, weight 2: %f, weight 3: %f, weight 4: %f\n", weight1, weight2, weight3, weight4);
-		trialEnergy = energy( projPref ); /* energy of our new allocation */
-		//printf("current energy and trial energy, %d, %d\n", currentEnergy, trialEnergy);
-		changeEnergy = (float)( trialEnergy - currentEnergy ); 
-		ratioEnergy = fabs( (float)trialEnergy / (float)currentEnergy ); /*need to be floats for things to work */
-
-		vector_random_generator(1,rands);
-		
-		lecClashes=countSupConstraintClashes( supConstraint, projNum, projNum[changes[0]] ); /* projNum[changes[0]] != changes[1] at this point. The former is current proj, the latter old proj */		
-
-		if ( projClashFullCount( projNum ) > 0 ) { /* Reject configuration due to clash - revert changes and reduce succesful move counter */
-			projNum[changes[0]] = changes[1];
-			projPref[changes[0]] = changes[2];
-
-			successfulmoves--;
-		//	printf("ttttttttttttttthere was a clash\n");
-		} else if (temp > 0 && rands[0] > exp( -changeEnergy / temp ) ) { /* Reject configuration due to energy - revert changes */
-			projNum[changes[0]] = changes[1];
-			projPref[changes[0]] = changes[2];
-			successfulmoves--;
-		//	printf("reject due to energy\n");
-
-		} else if ( temp == 0 && trialEnergy > currentEnergy){ /* Reject due to energy in T=0 case */
-
-			projNum[changes[0]] = changes[1];
-			projPref[changes[0]] = changes[2];
-			successfulmoves--;
-		//	printf("reject due to energy\n");
-		} else if ( lecClashes>0 ) { /* reject due to lecturer constraint violation */
-			projNum[changes[0]] = changes[1];
-			projPref[changes[0]] = changes[2];
-			successfulmoves--;
-		//	printf("reject due to lecturers\n");
-		}
-			
-		if ( currentEnergy == trialEnergy ) { /* This is (in theory) impossible. We count because as its a nice tracker for if things are broken. */
-			//printf("This shouldn't be happening?\n\n");
-			same++;
-			successfulmoves--;
-		}	
-		
-		currentEnergy = energy( projPref );
-		//fprintf(saveData, "%d ", currentEnergy);
-		//fprintf(saveData, "\n");
-				
-	}
-}
-
-
-/* calculates energy of a given allocation. The weights are in here. RETURNS energy */
-float energy( int projPref[] ) {
-	int i = 0;
-	float energy = 0;
-	for ( i=0; i<cols; i++ ) {
-		switch ( projPref[i] ) {
-			case 1:
-				energy -= weight1;
+int main( int argc, char *argv[] ) {
+
+	struct problem *problem;
+	struct solver *solver;
+	struct rusage resources; /* for the peak memory */
+	struct sigaction stopAction;
+	char error[ERROR_LENGTH];
+	int option;
+	int tempGiven = 0; /* 1 if --tstart was given */
+	struct option options[] = {
+		{ "chains", required_argument, NULL, 'c' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "replicas", required_argument, NULL, 'r' },
+		{ "rounds", required_argument, NULL, 'n' },
+		{ "tmin", required_argument, NULL, 'l' },
+		{ "tmax", required_argument, NULL, 'h' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "rng", required_argument, NULL, 'G' },
+		{ "rng-test", required_argument, NULL, 'Y' },
+		{ "mix", required_argument, NULL, 'm' },
+		{ "schedule", required_argument, NULL, 'S' },
+		{ "kernel", required_argument, NULL, 'x' },
+		{ "tstart", required_argument, NULL, 'T' },
+		{ "tend", required_argument, NULL, 'E' },
+		{ "step", required_argument, NULL, 'd' },
+		{ "cooling", required_argument, NULL, 'a' },
+		{ "target-accept", required_argument, NULL, 'A' },
+		{ "frozen", required_argument, NULL, 'f' },
+		{ "rejection-free", required_argument, NULL, 'R' },
+		{ "target-energy", required_argument, NULL, 'g' },
+		{ "time-limit", required_argument, NULL, 'Z' },
+		{ "log-every", required_argument, NULL, 'L' },
+		{ "drift-check", required_argument, NULL, 'q' },
+		{ "progress", required_argument, NULL, 'P' },
+		{ "checkpoint", required_argument, NULL, 'k' },
+		{ "checkpoint-file", required_argument, NULL, 'K' },
+		{ "resume", no_argument, NULL, 'u' },
+		{ "bound", required_argument, NULL, 'b' },
+		{ "warm-start", no_argument, NULL, 'w' },
+		{ "batch", required_argument, NULL, 'B' },
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "previous", required_argument, NULL, 'p' },
+		{ "serve", required_argument, NULL, 'D' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	spaDefaults( &settings );
+	while ( ( option = getopt_long( argc, argv, "", options, NULL ) ) != -1 ) {
+		switch ( option ) {
+			case 'c':
+				settings.chains = atoi( optarg );
 				break;
-			case 2:
-				energy -= weight2;
+			case 't':
+				settings.threads = atoi( optarg );
 				break;
-			case 3:
-				energy -= weight3;	
+			case 'r':
+				settings.replicas = atoi( optarg );
 				break;
-			case 4:
-				energy -= weight4;
+			case 'n':
+				settings.rounds = atoi( optarg );
+				break;
+			case 'l':
+				settings.minTemp = atof( optarg );
+				break;
+			case 'h':
+				settings.maxTemp = atof( optarg );
+				break;
+			case 's':
+				settings.seed = atol( optarg );
+				break;
+			case 'm':
+				if ( sscanf( optarg, "%lf,%lf,%lf", &settings.moveMix[MOVE_SINGLE], &settings.moveMix[MOVE_SWAP], &settings.moveMix[MOVE_EJECT] ) != 3 ) {
+					fprintf(stderr, "--mix needs three weights, e.g. 2,1,1\n");
+					return 1;
+				}
+				break;
+			case 'S':
+				if ( strcmp( optarg, "linear" ) == 0 ) {
+					settings.schedule = SCHEDULE_LINEAR;
+				} else if ( strcmp( optarg, "geometric" ) == 0 ) {
+					settings.schedule = SCHEDULE_GEOMETRIC;
+				} else if ( strcmp( optarg, "adaptive" ) == 0 ) {
+					settings.schedule = SCHEDULE_ADAPTIVE;
+				} else {
+					fprintf(stderr, "Unknown schedule %s\n", optarg);
+					return 1;
+				}
 				break;
+			case 'x':
+				if ( strcmp( optarg, "off" ) == 0 ) {
+					settings.kernel = KERNEL_OFF;
+				} else if ( strcmp( optarg, "scalar" ) == 0 ) {
+					settings.kernel = KERNEL_SCALAR;
+				} else if ( strcmp( optarg, "sse" ) == 0 ) {
+					settings.kernel = KERNEL_SSE;
+				} else if ( strcmp( optarg, "avx2" ) == 0 ) {
+					settings.kernel = KERNEL_AVX2;
+				} else if ( strcmp( optarg, "auto" ) == 0 ) {
+					settings.kernel = KERNEL_AUTO;
+				} else {
+					fprintf(stderr, "Unknown kernel %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'G':
+				if ( strcmp( optarg, "ranvec" ) == 0 ) {
+					settings.generator = RNG_RANVEC;
+				} else if ( strcmp( optarg, "philox" ) == 0 ) {
+					settings.generator = RNG_PHILOX;
+				} else {
+					fprintf(stderr, "Unknown generator %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'Y':
+				rngTest = atol( optarg );
+				break;
+			case 'T':
+				settings.startTemp = ( strcmp( optarg, "auto" ) == 0 ) ? 0 : atof( optarg );
+				tempGiven = 1;
+				break;
+			case 'E':
+				settings.endTemp = atof( optarg );
+				break;
+			case 'd':
+				settings.coolStep = atof( optarg );
+				break;
+			case 'a':
+				settings.cooling = atof( optarg );
+				break;
+			case 'A':
+				settings.targetAccept = atof( optarg );
+				break;
+			case 'f':
+				settings.frozenLevels = atoi( optarg );
+				break;
+			case 'R':
+				settings.rejectionFree = atof( optarg );
+				break;
+			case 'g':
+				settings.targetEnergy = atof( optarg );
+				break;
+			case 'Z':
+				settings.timeLimit = atof( optarg );
+				break;
+			case 'L':
+				settings.logEvery = atoi( optarg );
+				break;
+			case 'q':
+				settings.driftCheck = atoi( optarg );
+				break;
+			case 'P':
+				settings.progressEvery = atoi( optarg );
+				break;
+			case 'k':
+				settings.checkpointEvery = atof( optarg );
+				break;
+			case 'K':
+				settings.checkpointFile = optarg;
+				break;
+			case 'u':
+				settings.resume = 1;
+				break;
+			case 'b':
+				settings.boundIterations = atoi( optarg );
+				break;
+			case 'w':
+				settings.warmStart = 1;
+				break;
+			case 'B':
+				batchFile = optarg;
+				break;
+			case 'j':
+				jobs = atoi( optarg );
+				break;
+			case 'p':
+				settings.previousFile = optarg;
+				break;
+			case 'D':
+				socketPath = optarg;
+				break;
+			default:
+				usage( argv[0] );
+				return 1;
 		}
 	}
-	
-	return energy;
-}
-
-/* Counts how many clashes there are in the allocation. RETURNS this. If 0, no clashes. */
-int projClashFullCount ( int projNum[] ){
-	int i, j, count = 0;
-	for ( i = 0; i < cols; i++) {
-		for ( j = i; j < cols; j++) {
-			if ( i != j ) {
-				if ( projNum[i] == projNum[j] ) {
-					count++;
-				 }
-			}
-		}
+	if ( argc - optind == 2 && batchFile == NULL && socketPath == NULL ) {
+		fileName1 = argv[optind];
+		fileName2 = argv[optind+1];
+	} else if ( argc - optind == 1 && batchFile == NULL && socketPath == NULL ) {
+		compiledFile = argv[optind];
+	} else if ( argc != optind ) {
+		usage( argv[0] );
+		return 1;
 	}
-	return count;
-}
-
-/* important number generator thingy */
-void generateRandomNumbers() {
-
-	long int seed, nrand=100000;
-  
-	time((time_t *)&seed);
-	init_vector_random_generator(seed,nrand);
-}
-
-/* takes a random Number (which is between 0 and 1) and makes it between whatever we want. RETURNS this number. */ 
-int randomNum( float random, int divisor ) {
-	int number;
-	random = random * 10000;
-  	number = (int) random%divisor;
-	return number;
-}
-
-/* This functions CHANGES THE ALLOCATION. Based on picking a pair, and then picking a project, and then making the change. Stores the change nicely in the changes function.*/
-void changeAllocationByPref( int choices[rows][cols], int projNum[cols], int projPref[cols], int changes[] ) {
-	int pair, pref;
-	int j;
-	int go = 0; /* while looper */
-	
-	vector_random_generator(1, rands);
-	pair = randomNum(rands[0], cols);
-	//printf("\npair current pref is %d\n", projPref[pair]);
-
-	while( go == 0){ /* avoid picking same preference - waste of a move and time. */
-		vector_random_generator(1,rands);
-		pref = randomNum(rands[0], 4);
-		//printf("chosen pref is %d\n", pref+1);
-		if ( projPref[pair] != pref+1 ) { /* then project will try and change. pref+1 as pref in [0,3] need [1,4] */
-			go = 1;
-		}
+	if ( settings.chains < 1 || settings.threads < 0 || settings.replicas < 0 || settings.rounds < 1 || settings.minTemp <= 0 || settings.maxTemp < settings.minTemp ) {
+		fprintf(stderr, "Need --chains of 1 or more, --threads and --replicas of 0 or more, --rounds of 1 or more and 0 < --tmin <= --tmax\n");
+		return 1;
 	}
-	changes[0] = pair;
-	changes[1] = projNum[pair];
-	changes[2] = projPref[pair]; /* = choices[changes[1]][changes[0]] = choices[projNum[pair]][pair]*/
-	//printf("Energy before reallocation is %d\n", energy(projPref));
-	/* make the change */
-	for( j=0; j<rows; j++){
-		if( choices[j][pair] == pref+1 ) {
-			projNum[pair] = j;
-			projPref[pair] = pref+1;
-		}
+	if ( settings.moveMix[MOVE_SINGLE] < 0 || settings.moveMix[MOVE_SWAP] < 0 || settings.moveMix[MOVE_EJECT] < 0 || settings.moveMix[MOVE_SINGLE] + settings.moveMix[MOVE_SWAP] + settings.moveMix[MOVE_EJECT] <= 0 ) {
+		fprintf(stderr, "--mix weights cannot be negative, and one must be above 0\n");
+		return 1;
 	}
-	//printf("Energy after reallocation is %d\n", energy(projPref));
-
-}
-
-/* Does what it says. RETURNS a count */
-int countViolations( int projNum[], float supConstraint[rows][numLec] ) {
-	int count=0;
-	int k;
-	count += projClashFullCount(projNum);
-	for ( k=0; k<cols; k++ ) {
-		count +=countSupConstraintClashes( supConstraint, projNum, projNum[k] );
+	if ( settings.startTemp < 0 || settings.endTemp <= 0 || settings.coolStep <= 0 || settings.cooling <= 0 || settings.cooling >= 1 || settings.targetAccept < 0 || settings.targetAccept > 1 || settings.frozenLevels < 0 || settings.rejectionFree < 0 || settings.rejectionFree > 1 || settings.logEvery < 0 || settings.driftCheck < 0 || settings.progressEvery < 0 ) {
+		fprintf(stderr, "Need --tstart of 0 (auto) or more, --tend and --step above 0, --cooling between 0 and 1, --target-accept and --rejection-free from 0 to 1 and --frozen, --log-every, --drift-check and --progress of 0 or more\n");
+		return 1;
+	}
+	if ( settings.replicas > 0 && settings.chains > 1 ) {
+		fprintf(stderr, "Use either --replicas or --chains, not both\n");
+		return 1;
+	}
+	if ( settings.boundIterations < 0 || jobs < 0 || settings.timeLimit < 0 ) {
+		fprintf(stderr, "Need --bound, --jobs and --time-limit of 0 or more\n");
+		return 1;
+	}
+	if ( batchFile != NULL && ( settings.checkpointEvery > 0 || settings.resume ) ) {
+		fprintf(stderr, "--checkpoint and --resume do not work with --batch\n");
+		return 1;
+	}
+	if ( settings.previousFile != NULL && ( settings.resume || settings.warmStart || batchFile != NULL || settings.replicas > 0 || settings.chains > 1 ) ) {
+		fprintf(stderr, "--previous only works with a single annealing chain started afresh, not with --resume, --warm-start, --batch, --chains or --replicas\n");
+		return 1;
+	}
+	if ( settings.warmStart && ( settings.replicas > 0 || settings.chains > 1 ) ) {
+		fprintf(stderr, "--warm-start only works with a single annealing chain, not with --chains or --replicas\n");
+		return 1;
+	}
+	if ( socketPath != NULL && ( batchFile != NULL || settings.checkpointEvery > 0 || settings.resume || settings.previousFile != NULL ) ) {
+		fprintf(stderr, "--serve does not work with --batch, --checkpoint, --resume or --previous\n");
+		return 1;
+	}
+	if ( tempGiven ) {
+		settings.previousTemp = 0;
+	}
+	if ( settings.checkpointEvery < 0 || ( ( settings.checkpointEvery > 0 || settings.resume ) && ( settings.replicas > 0 || settings.chains > 1 ) ) ) {
+		fprintf(stderr, "--checkpoint takes seconds, and it and --resume only work with a single annealing chain\n");
+		return 1;
+	}
+	if ( settings.seed == 0 ) {
+		settings.seed = (long int) time( NULL );
+	}
+	printf("Seed %ld\n", settings.seed);
+	if ( rngTest > 0 ) {
+		return spaTestGenerators( settings.seed, rngTest, stdout ) == 0 ? 0 : 1;
+	}
+	if ( batchFile != NULL ) {
+		return runBatch( batchFile, jobs, &settings );
+	}
+	if ( socketPath != NULL ) {
+		return runDaemon( socketPath, jobs, &settings );
 	}
 
-	return count;
-}
-	
-/* counts how many times the lecturer/supervisor constraint is violated. */
-int countSupConstraintClashes(float supConstraint[rows][numLec], int projNum[], int proj){ //for each project assigned to a pair, how many times is lecturer constraint violated.
-	int i, j, l; 
-	/*
-	j is lectrer
-	i is project / row
-	l is pair.
-	*/
-	float sum = 0;
-	int clash = 0;
-	/*so, for the project proj we look across the row to see which supervisors it has. Then we go down the supervisors column and sum up the energy of the projects allocated ONLY (projNum==i bit). If sum > 1, violation */
-	for( j = 0; j < numLec; j++ ) {
-		sum = 0;
-		if( supConstraint[proj][j] != 0 ) {
-			for( i = 0; i < rows; i++ ) {
-				for( l = 0; l < cols; l++ ) {
-					if( projNum[l] == i ) {
-						sum += supConstraint[i][j];
-					}
-				}
-			}
-
-			if ( sum > 1) { 
-				clash++;
-			}
-		}
+	/* read in Data. This also gives the size of the problem, so we can make room for it all in one go */
+	if ( compiledFile != NULL ) {
+		problem = spaLoadCompiled( compiledFile, error );
+	} else {
+		problem = spaLoadProblem( fileName1, fileName2, error );
+	}
+	if ( problem == NULL ) {
+		fprintf(stderr, "%s\n", error);
+		return 1;
+	}
+	solver = spaNewSolver( problem, &settings, stdout, error );
+	if ( solver == NULL ) {
+		fprintf(stderr, "%s\n", error);
+		return 1;
+	}
+	running = solver;
+	stopAction.sa_handler = stopRunning;
+	sigemptyset( &stopAction.sa_mask );
+	stopAction.sa_flags = SA_RESETHAND; /* a second Ctrl-C kills it outright */
+	sigaction( SIGINT, &stopAction, NULL );
+	sigaction( SIGTERM, &stopAction, NULL );
+	if ( spaSolve( solver, "newData.txt", error ) != 0 ) {
+		fprintf(stderr, "%s\n", error);
+		return 1;
 	}
-	return clash;
+	getrusage( RUSAGE_SELF, &resources );
+	printf("Peak memory %ld kB\n", resources.ru_maxrss);
+	if ( spaWriteAllocation( solver, "finalConfig.txt" ) != 0 ) {
+		fprintf(stderr, "Could not write finalConfig.txt\n");
+		return 1;
+	}
+	spaFreeSolver( solver );
+	spaFreeProblem( problem );
+	return 0;
 }
 
-/* create an initial configuration. Start at random, and then accept any change (again randomly determined) that reduces the number of constraints being violated. We are finished when no constraints are being vioalted. */
-
-void createInitialConfiguration( int choices[rows][cols], int projNum[cols], int projPref[cols], int changes[], float supConstraint[rows][numLec] ) {
-
-	int violationCount1, violationCount2; /* count number of violations. 1 is "old", 2 is "current" */
-	int pref; /* integer from 1 to 4 */
-	int i, j; /* loop counters */
-	for ( i=0; i<cols; i++ ) {
-      
-		vector_random_generator(1,rands);
-		pref = randomNum(rands[0], 4);
-		
-		for( j=0; j<rows; j++) { /* find the choice with the preference, and assign it */	
-			if( choices[j][i] == pref+1 ){
-				projNum[i] = j;
-				projPref[i] = pref + 1;
-			}
-		}
-	}	
-
-	
-	violationCount1 = countViolations( projNum, supConstraint );
-	while( violationCount1 > 0 ){
-	  //	  printf("violationCount1=%i\n",violationCount1);
-
-		changeAllocationByPref( choices, projNum, projPref, changes );
-		violationCount2 = countViolations( projNum, supConstraint );
-		if( violationCount2 > violationCount1 ) { /* In this case, the number of violations has INCREASED, so we REJECT it and REVERT to the old allocation. */
-			projNum[changes[0]] = changes[1];
-			projPref[changes[0]] = changes[2];
-		} else { /* update violationCount1 */	
-			violationCount1 = violationCount2; 
-		}
-		
+/* The run stops at the end of the temperature it is on and the allocation is written out as usual. */
+void stopRunning( int signalNumber ) {
+	(void) signalNumber;
+	if ( running != NULL ) {
+		spaInterrupt( running );
 	}
-
 }
 
-/* read in the data for which pairs have what projects as their choices */
-void readChoices ( int choices[rows][cols] ) {
-	FILE *data;
-	int x, y=0, z=0; /* x is our character as an integer, y is the row of the choices array, and z the column. */
-	char c='A', d=','; /* c is the character currently being read. d is the last character read. Start with a comma. */
-	data = fopen(fileName1, "r");
-	/* read through file char by char */
-	while( c != EOF ) {
-		c =  fgetc(data);
-		x = c - '0'; /* turn to int */
-		switch( c ) {
-			case ',': /* if two commas in a row, then a zero...Can't think of a case where this isn't true, unless the data was weirdly spaced or something. */
-				if ( d == ',' ) { /* last choice was a comma then we have had an "empty space" in our data table - so a zero */
-					choices[y][z] = 0;
-					z++;
-				}
-				break;
-				
-			case '\n': /* new line - so reset column, move on to new row, make d a comma again */
-				y++;
-				z = 0;
-				c = ','; /* because c becomes d after the switch, and this helps tell if there is a zero at the start of a new line. */
-				break;
-				
-			case EOF: /* end of file */
-				break;
-				
-			case '\r': /* this happens at end of lines, before new lines */
-				if ( d==',' ) { /* if comma last thing before end of line, zero again. */
-					choices[y][z] = 0;
-				};
-				break;
-				
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-				choices[y][z] = x;
-				z++;
-				break;
-			default:
-				break;
-			}
-
-		d = c; /* update last char. */
-		}	
-	fclose(data);
+void usage( char *program ) {
+	struct settings defaults; /* not what the options have made them */
+	spaDefaults( &defaults );
+	fprintf(stderr, "Usage: %s [options] [choices.csv supervisors.csv | instance.spab]\n       %s [options] --batch manifest\n       %s [options] --serve socket\n", program, program, program);
+	fprintf(stderr, "  --mix S,W,E   how often single moves, swaps and ejections are tried, relative to each other (default 1,0,0)\n");
+	fprintf(stderr, "  --schedule S  how to cool: linear, geometric or adaptive (default linear)\n");
+	fprintf(stderr, "  --kernel K    how single moves are priced: off (one at a time), scalar, sse, avx2 or auto (default auto)\n");
+	fprintf(stderr, "  --tstart T    starting temperature, or auto to work it out from sample moves (default %g)\n", defaults.startTemp);
+	fprintf(stderr, "  --tend T      geometric and adaptive: stop below this temperature (default %g)\n", defaults.endTemp);
+	fprintf(stderr, "  --step D      linear: drop in temperature each level (default %g)\n", defaults.coolStep);
+	fprintf(stderr, "  --cooling A   geometric and adaptive: multiply the temperature by this each level (default %g)\n", defaults.cooling);
+	fprintf(stderr, "  --target-accept R  acceptance rate below which adaptive cools half as fast and --frozen counts (default %g)\n", defaults.targetAccept);
+	fprintf(stderr, "  --frozen K    stop once K temperatures in a row, each below the target acceptance rate, have not improved the best energy (default 0, never)\n");
+	fprintf(stderr, "  --rejection-free R  switch to rejection-free moves once fewer than R of the moves are accepted, 0 never (default %g)\n", defaults.rejectionFree);
+	fprintf(stderr, "  --target-energy E  stop once the energy gets down to E, and report how long that took\n");
+	fprintf(stderr, "  --time-limit S  finish within S seconds, cooling faster to fit them in, 0 no limit (default 0). Ctrl-C also finishes early\n");
+	fprintf(stderr, "  --log-every N  write a line to newData.txt every N temperatures, 0 none (default %d)\n", defaults.logEvery);
+	fprintf(stderr, "  --drift-check N  check the running energy against one worked out afresh every N moves, 0 never (default %d)\n", defaults.driftCheck);
+	fprintf(stderr, "  --checkpoint S  save the run to the checkpoint file every S seconds, 0 never (default 0)\n");
+	fprintf(stderr, "  --checkpoint-file F  where to save checkpoints (default %s)\n", defaults.checkpointFile);
+	fprintf(stderr, "  --resume      carry on from the checkpoint file. Give the same options and files as the run that saved it\n");
+	fprintf(stderr, "  --bound N     rounds of pricing to work out a lower bound on the energy with, 0 none (default %d)\n", defaults.boundIterations);
+	fprintf(stderr, "  --warm-start  start from the best allocation the lower bound found, not a random one\n");
+	fprintf(stderr, "  --previous F  start from the allocation in F, an earlier finalConfig.txt, changing it as little as the files now allow. Starts at --tstart %g of a first choice's energy unless given\n", defaults.previousTemp);
+	fprintf(stderr, "  --batch F     solve every problem listed in manifest F instead of the two files (see batch.c)\n");
+	fprintf(stderr, "  --serve P     run as a daemon, taking load and solve requests on the Unix socket P (see daemon.c)\n");
+	fprintf(stderr, "  --jobs N      --batch and --serve: how many problems to solve at once (default one per core)\n");
+	fprintf(stderr, "  --progress N  print the temperature and energy every N temperatures, 0 none (default %d)\n", defaults.progressEvery);
+	fprintf(stderr, "  --chains N    anneal N independent chains, each seeded differently, and keep the best (default 1)\n");
+	fprintf(stderr, "  --threads N   threads to run the chains on (default one per core)\n");
+	fprintf(stderr, "  --replicas N  run parallel tempering with N replicas, one thread each (default 0: one annealing chain)\n");
+	fprintf(stderr, "  --rounds N    parallel tempering: cycles of moves per replica (default %d)\n", defaults.rounds);
+	fprintf(stderr, "  --tmin T      parallel tempering: coldest temperature (default %g)\n", defaults.minTemp);
+	fprintf(stderr, "  --tmax T      parallel tempering: hottest temperature (default %g)\n", defaults.maxTemp);
+	fprintf(stderr, "  --seed S      seed for the random numbers (default from the time)\n");
+	fprintf(stderr, "  --rng G       random number generator: ranvec, or philox for a stream of its own for every chain (default ranvec)\n");
+	fprintf(stderr, "  --rng-test N  just check both generators on N numbers each, and exit\n");
 }
-
-/* reads in the lecturer constraint into supConstraint */
-void readLecturers( float supConstraint[rows][numLec] ) {
-	FILE* data;
-	int y = 0, z = 0, i = 1; /* y is the ROW (project), z is the COLUMN (suprevisor). i keeps track of decimal places in the numbers being read in. */
-	char c='A', d=','; /* c is char being read in. d the previous char */
-	float tempVar=0, x; /* x is the float version of the charcter being read in c. tempVar is a temporary sum */
-	data = fopen(fileName2, "r");
-	
-	while( c != EOF ) { 
-		c =  fgetc(data);
-		x = (float) c - '0'; 
-		
-		switch(c) {
-			case ',': 
-				if ( d==',' ) { /* empty cell. add zero */
-					supConstraint[y][z] = 0;
-					z++;
-				} else if ( tempVar>0 ) { /* if we have a non-empty value, we add it to the array */
-					supConstraint[y][z] = tempVar;
-					z++;
-					i = 1;
-					tempVar = 0;
-				}
-				break;
-				
-			case '\n': /* reset column, new row */
-				y++;
-				z = 0;
-				c = ','; 
-				break;
-				
-			case EOF: /* end of file */
-				break;
-				
-			case '\r': /* this happens at end of lines, before new lines */
-				if ( d == ',' ) { /* if comma last thing before end of line, zero again. */
-					supConstraint[y][z] = 0;
-				} else if ( tempVar>0 ) {
-					supConstraint[y][z] = tempVar;
-					z++;
-					i = 1;
-					tempVar = 0;
-				}
-				break;
-				
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-			case '0':
-			/* this is messy to deal with decimals */
-				tempVar += x/i;
-				i = i*10;
-				break;
-				
-			case '.':
-				break;
-			default:
-				break;
-			}
-
-		d = c; /* update last char. */
-		}
-	fclose(data);
-	
-}	
-	
@@ -0,0 +1,851 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  The annealing itself: the moves, the ledger kept alongside the allocation, the energy, the random       */
+/*  numbers and the cooling schedule. Everything a chain needs is in the chain, or in the problem and the   */
+/*  solver it points back to, so any number of chains can be annealed at once.                              */
+/************************************************************************************************************/
+
+double calibrateTemp( struct chain *chain ); /* works out a starting temperature from the cost of some sample moves */
+double nextTemp( struct settings *settings, double temp, struct cycleStats stats ); /* the temperature after temp, according to the schedule */
+double keepPace( struct chain *chain, double temp, double next, int levels, long int moves, double started ); /* next, or lower if the rest of the schedule would not be done by the chain's deadline */
+void saveBest( struct chain *chain ); /* copies the allocation into the chain's best */
+void saveCheckpoint( struct chain *chain, FILE *saveData, struct annealState *state ); /* writes the checkpoint for state */
+int randRaw( struct randStream *rng ); /* next raw integer from the stream */
+void proposeMove( struct chain *chain ); /* makes a move of a kind picked by moveMix */
+void changeAllocationByPref( struct chain *chain ); /* changes allocation of ONE PAIRS project based on random choice of preference */
+void swapPairs( struct chain *chain ); /* one pair takes another's project, which takes the first's */
+void ejectPair( struct chain *chain ); /* one pair takes another's project, which moves on to another of its choices */
+void shiftPair( struct chain *chain, int pair, int proj, int pref ); /* movePair, noting it in the move */
+void undoMove( struct chain *chain ); /* puts every pair in the move back */
+float moveEnergy( struct chain *chain ); /* the change in energy the move made */
+int holderOf( struct choices *choices, int projNum[], int proj, int pair ); /* a pair other than pair on proj */
+int countSupConstraintClashes( struct supervisors *sups, struct ledger *ledger, int proj); /*counts violations of lectuere constraint */
+void addStats( struct cycleStats *total, struct cycleStats stats ); /* adds stats on to total */
+void logLevel( struct solver *solver, FILE *saveData, int level, double temp, float currentEnergy, float bestEnergy, struct cycleStats *stats ); /* writes a line of telemetry, and starts stats again from zero */
+
+/* The weights for each preference. These are scaled so that every pair getting their first choice is an energy of -100 */
+void setWeights( struct solver *solver ) {
+	float *score = solver->settings.score;
+	int cols = solver->problem->cols;
+	int k;
+	solver->weight[0] = 0;
+	solver->weight[1] = (float)100/(float)cols;
+	for ( k = 2; k <= NUMPREFS; k++ ) {
+		solver->weight[k] = ((float)100/(float)cols) * (score[k-1]/score[0]);
+	}
+}
+
+/* Adds up what the choices and supervisors take off the problem's arena. Each piece is rounded up to 16 bytes, the same as arenaAlloc does. */
+size_t problemBytes( struct problem *problem, int links ) {
+	size_t bytes = 0;
+	bytes += ARENA_ROUND( problem->cols * NUMPREFS * sizeof(int) ); /* choices */
+	bytes += ARENA_ROUND( ( problem->rows + 1 ) * sizeof(int) );
+	bytes += 2 * ARENA_ROUND( problem->cols * NUMPREFS * sizeof(int) );
+	bytes += 2 * ARENA_ROUND( ( links + 1 ) * sizeof(int) ) + 2 * ARENA_ROUND( ( links + 1 ) * sizeof(float) ); /* supervisors */
+	bytes += ARENA_ROUND( ( problem->rows + 1 ) * sizeof(int) ) + ARENA_ROUND( ( problem->numLec + 1 ) * sizeof(int) );
+	return bytes;
+}
+
+/* Adds up what allocChain takes off the arena. */
+size_t chainBytes( struct problem *problem ) {
+	size_t bytes = 0;
+	bytes += ARENA_ROUND( problem->rows * sizeof(int) ) + ARENA_ROUND( problem->numLec * sizeof(double) ); /* ledger */
+	bytes += 4 * ARENA_ROUND( problem->cols * sizeof(int) ); /* projNum and projPref, and the best of them */
+	bytes += ARENA_ROUND( RAND_BUFFER * sizeof(int) ); /* random numbers */
+	bytes += rateTreeBytes( problem );
+	bytes += moveBlockBytes();
+	return bytes;
+}
+
+/* RETURNS the next bytes of the arena. The arena is sized by adding up what everything will take, so running out means the two do not agree. */
+void *arenaAlloc( struct arena *arena, size_t bytes ) {
+	void *memory = arena->base + arena->used;
+	arena->used += ARENA_ROUND( bytes );
+	if ( arena->used > arena->size ) {
+		fprintf(stderr, "Arena is too small\n");
+		exit(1);
+	}
+	return memory;
+}
+
+void allocChoices( struct problem *problem ) {
+	struct choices *choices = &problem->choices;
+	choices->prefProj = arenaAlloc( &problem->arena, problem->cols * NUMPREFS * sizeof(int) );
+	choices->chooserStart = arenaAlloc( &problem->arena, ( problem->rows + 1 ) * sizeof(int) );
+	choices->chooser = arenaAlloc( &problem->arena, problem->cols * NUMPREFS * sizeof(int) );
+	choices->chooserPref = arenaAlloc( &problem->arena, problem->cols * NUMPREFS * sizeof(int) );
+}
+
+void allocSupervisors( struct problem *problem, int links ) {
+	struct supervisors *sups = &problem->sups;
+	sups->links = links;
+	sups->lec = arenaAlloc( &problem->arena, ( links + 1 ) * sizeof(int) );
+	sups->weight = arenaAlloc( &problem->arena, ( links + 1 ) * sizeof(float) );
+	sups->proj = arenaAlloc( &problem->arena, ( links + 1 ) * sizeof(int) );
+	sups->projWeight = arenaAlloc( &problem->arena, ( links + 1 ) * sizeof(float) );
+	sups->projStart = arenaAlloc( &problem->arena, ( problem->rows + 1 ) * sizeof(int) );
+	sups->lecStart = arenaAlloc( &problem->arena, ( problem->numLec + 1 ) * sizeof(int) );
+}
+
+void allocLedger( struct ledger *ledger, struct problem *problem, struct arena *arena ) {
+	ledger->projOcc = arenaAlloc( arena, problem->rows * sizeof(int) );
+	ledger->lecLoad = arenaAlloc( arena, problem->numLec * sizeof(double) );
+	ledger->clashCount = 0;
+	ledger->lecOver = 0;
+}
+
+void allocChain( struct chain *chain, struct solver *solver, int stream, struct arena *arena ) {
+	chain->problem = solver->problem;
+	chain->solver = solver;
+	allocLedger( &chain->ledger, chain->problem, arena );
+	chain->projNum = arenaAlloc( arena, chain->problem->cols * sizeof(int) );
+	chain->projPref = arenaAlloc( arena, chain->problem->cols * sizeof(int) );
+	chain->bestNum = arenaAlloc( arena, chain->problem->cols * sizeof(int) );
+	chain->bestPref = arenaAlloc( arena, chain->problem->cols * sizeof(int) );
+	initRandStream( &chain->rng, solver->settings.generator, solver->settings.seed, stream, arena );
+	allocRateTree( &chain->tree, chain->problem, arena );
+	allocMoveBlock( &chain->block, arena );
+	chain->kernel = solver->kernel;
+	chain->currentEnergy = 0;
+	chain->moves = 0;
+	chain->targetTime = -1;
+	chain->deadline = solver->settings.timeLimit;
+}
+
+void freeChain( struct chain *chain ) {
+	freeRandStream( &chain->rng );
+}
+
+/* Simulated Annealing time 
+   So, we stay at one temperature until either 1000*cols moves or 100*cols Succesful Moves. 
+   Then decrease, as the schedule says, and go again. The chain must already have a starting configuration WITH NO VIOLATIONS.
+   Geometric and adaptive end with one level at zero temperature, to take the allocation to the bottom of whichever minimum it is in.
+   Once hardly any moves are being accepted, the rest of the run is done with rejection-free moves, which go the same way only faster.
+   Telemetry is only written between levels, so it costs the moves nothing.
+   Given a state, a checkpoint is saved to checkpointFile between levels every checkpointEvery seconds, and if the state has a level done it carries on from there rather than starting afresh.
+   The lowest energy allocation at the end of any level is kept, and the chain finishes on that rather than wherever the last level left it.
+   Given a deadline, the rest of the schedule is squeezed to fit the time left (keepPace), and a level still going at the deadline is cut short. It stops early, between
+   levels, once it is out of time, once it or another chain of the solver gets down to targetEnergy, or once the solver is interrupted. */
+void anneal( struct chain *chain, int verbose, FILE *saveData, struct annealState *state ) {
+	struct solver *solver = chain->solver;
+	struct settings *settings = &solver->settings;
+	double temp = settings->startTemp;
+	float bestEnergy;
+	int stale = 0; /* settled temperatures in a row without a new best */
+	int noRejections = 0; /* 1 once switched to rejection-free moves */
+	int level = 0; /* temperatures done */
+	int levels = 0; /* of them, done in this call */
+	struct cycleStats stats;
+	struct cycleStats logged = { 0, 0, 0, 0, 0, 0 }; /* added up since the last line of telemetry */
+	double lastCheckpoint = wallTime( solver );
+	double started = lastCheckpoint;
+	long int startMoves = chain->moves;
+
+	if ( state != NULL && state->level > 0 ) { /* carry on from a checkpoint. The chain and its best have been put back as they were */
+		temp = state->temp;
+		level = state->level;
+		stale = state->stale;
+		noRejections = state->noRejections;
+		bestEnergy = state->bestEnergy;
+		logged = state->logged;
+	} else {
+		chain->currentEnergy = energy( solver, chain->projPref );
+		bestEnergy = chain->currentEnergy;
+		saveBest( chain );
+		if ( temp == 0 ) {
+			temp = calibrateTemp( chain );
+			if ( verbose ) {
+				report( solver, "Starting temperature %f\n\n", temp);
+			}
+		}
+	}
+	while ( settings->schedule == SCHEDULE_LINEAR ? temp >= 0 : temp >= settings->endTemp ) {
+		if ( verbose && settings->progressEvery > 0 && level % settings->progressEvery == 0 ) {
+			report( solver, "Temperature %f\nCurrent Energy = %f\n\n", temp, chain->currentEnergy);
+		}
+		if ( noRejections ) {
+			stats = cycleOfMovesRejectionFree( chain, temp );
+		} else {
+			stats = cycleOfMoves( chain, temp );
+		}
+		if ( !noRejections && stats.accepted < settings->rejectionFree * stats.moves && settings->moveMix[MOVE_SWAP] == 0 && settings->moveMix[MOVE_EJECT] == 0 ) { /* rejection-free only knows single moves */
+			noRejections = 1;
+			if ( verbose ) {
+				report( solver, "Switching to rejection-free moves at temperature %f\n\n", temp);
+			}
+		}
+		if ( chain->currentEnergy < bestEnergy - 1e-4 ) { /* allow for rounding in the running energy */
+			bestEnergy = chain->currentEnergy;
+			saveBest( chain );
+			noteTarget( chain, bestEnergy );
+			stale = 0;
+		} else if ( stats.accepted > settings->targetAccept * stats.moves ) { /* still moving about too much to say it is frozen. At high temperature the best is only ever found by chance */
+			stale = 0;
+		} else {
+			stale++;
+		}
+		level++;
+		levels++;
+		addStats( &logged, stats );
+		if ( saveData != NULL && settings->logEvery > 0 && level % settings->logEvery == 0 ) {
+			logLevel( solver, saveData, level, temp, chain->currentEnergy, bestEnergy, &logged );
+		}
+		if ( chain->currentEnergy <= solver->lowerBound + 0.02 * solver->weight[1] && energy( solver, chain->projPref ) <= solver->lowerBound + 0.01 * solver->weight[1] ) { /* within rounding of the bound, so nothing better exists */
+			if ( verbose ) {
+				report( solver, "Reached the lower bound at temperature %f, so the allocation is the best there is\n\n", temp);
+			}
+			break;
+		}
+		if ( !isnan( settings->targetEnergy ) && bestEnergy <= settings->targetEnergy ) {
+			solver->targetReached = 1; /* so every other chain stops too */
+			if ( verbose ) {
+				report( solver, "Reached energy %f, stopping at temperature %f\n\n", settings->targetEnergy, temp);
+			}
+			break;
+		}
+		if ( solver->targetReached ) {
+			if ( verbose ) {
+				report( solver, "Another chain reached energy %f, stopping at temperature %f\n\n", settings->targetEnergy, temp);
+			}
+			break;
+		}
+		if ( solver->interrupted ) {
+			if ( verbose ) {
+				report( solver, "Interrupted, stopping at temperature %f\n\n", temp);
+			}
+			if ( state != NULL && settings->checkpointEvery > 0 ) { /* so it can be carried on from here */
+				*state = (struct annealState) { settings->schedule, nextTemp( settings, temp, stats ), level, stale, noRejections, bestEnergy, logged, 0 };
+				saveCheckpoint( chain, saveData, state );
+			}
+			break;
+		}
+		if ( chain->deadline > 0 && wallTime( solver ) >= chain->deadline ) {
+			if ( verbose ) {
+				report( solver, "Out of time after %.3f s, stopping at temperature %f\n\n", wallTime( solver ), temp);
+			}
+			break;
+		}
+		if ( settings->frozenLevels > 0 && stale >= settings->frozenLevels ) {
+			if ( verbose ) {
+				report( solver, "No improvement in %d temperatures, stopping at temperature %f\n\n", settings->frozenLevels, temp);
+			}
+			break;
+		}
+		/* decrease temp */
+		temp = keepPace( chain, temp, nextTemp( settings, temp, stats ), levels, chain->moves - startMoves, started );
+		if ( state != NULL && settings->checkpointEvery > 0 && wallTime( solver ) - lastCheckpoint >= settings->checkpointEvery ) {
+			*state = (struct annealState) { settings->schedule, temp, level, stale, noRejections, bestEnergy, logged, 0 };
+			saveCheckpoint( chain, saveData, state );
+			lastCheckpoint = wallTime( solver );
+		}
+	}
+	if ( settings->schedule != SCHEDULE_LINEAR && !solver->interrupted && !solver->targetReached ) {
+		temp = 0;
+		stats = noRejections ? cycleOfMovesRejectionFree( chain, 0 ) : cycleOfMoves( chain, 0 );
+		level++;
+		addStats( &logged, stats );
+		if ( chain->currentEnergy < bestEnergy ) {
+			bestEnergy = chain->currentEnergy;
+			saveBest( chain );
+			noteTarget( chain, bestEnergy );
+		}
+	}
+	if ( saveData != NULL && settings->logEvery > 0 && logged.moves > 0 ) { /* whatever is left over since the last line */
+		logLevel( solver, saveData, level, temp, chain->currentEnergy, bestEnergy, &logged );
+	}
+	if ( chain->currentEnergy > bestEnergy + 1e-4 ) { /* uphill moves since the best have left it worse off */
+		if ( verbose ) {
+			report( solver, "Going back to the best allocation seen, energy %f rather than %f\n\n", bestEnergy, chain->currentEnergy);
+		}
+		memcpy( chain->projNum, chain->bestNum, chain->problem->cols * sizeof(int) );
+		memcpy( chain->projPref, chain->bestPref, chain->problem->cols * sizeof(int) );
+		rebuildLedger( chain );
+		chain->currentEnergy = energy( solver, chain->projPref );
+	}
+}
+
+void saveBest( struct chain *chain ) {
+	memcpy( chain->bestNum, chain->projNum, chain->problem->cols * sizeof(int) );
+	memcpy( chain->bestPref, chain->projPref, chain->problem->cols * sizeof(int) );
+}
+
+void saveCheckpoint( struct chain *chain, FILE *saveData, struct annealState *state ) {
+	struct settings *settings = &chain->solver->settings;
+	if ( saveData != NULL ) {
+		fflush( saveData ); /* so the telemetry is not behind the checkpoint */
+		state->logBytes = ftell( saveData );
+	}
+	if ( writeCheckpoint( settings->checkpointFile, chain, state, settings->seed ) != 0 ) {
+		fprintf(stderr, "Could not write checkpoint %s\n", settings->checkpointFile);
+	}
+}
+
+/* At the pace of the levels done so far in this call (levels of them, making moves proposals), works out how many more there is time for before the chain's deadline,
+   keeping back time for the level at zero temperature and one more level for writing out the results. The hot levels end early, at 100*cols accepted moves, but the
+   one at zero temperature makes all 1000*cols proposals, so it is budgeted at that many at the pace of the proposals so far rather than as an average level.
+   If that is fewer than the schedule has left, the rest of it is squeezed into them, going down to the same end temperature in bigger steps.
+   RETURNS next, or the lower temperature to go to instead */
+double keepPace( struct chain *chain, double temp, double next, int levels, long int moves, double started ) {
+	struct settings *settings = &chain->solver->settings;
+	double now, lastLevel, affordable, levelsLeft;
+	if ( chain->deadline <= 0 || levels == 0 || moves == 0 || next <= 0 || next >= temp ) {
+		return next;
+	}
+	now = wallTime( chain->solver );
+	lastLevel = 1000.0 * chain->problem->cols * ( now - started ) / moves;
+	affordable = ( chain->deadline - now - lastLevel ) / ( ( now - started ) / levels ) - 1;
+	if ( settings->schedule == SCHEDULE_LINEAR ) {
+		levelsLeft = next / settings->coolStep;
+		if ( affordable >= levelsLeft ) {
+			return next;
+		}
+		return affordable < 1 ? 0 : temp - temp / affordable;
+	}
+	if ( next <= settings->endTemp ) {
+		return next;
+	}
+	levelsLeft = log( settings->endTemp / next ) / log( next / temp );
+	if ( affordable >= levelsLeft ) {
+		return next;
+	}
+	return affordable < 1 ? settings->endTemp * ( next / temp ) : temp * pow( settings->endTemp / temp, 1 / affordable );
+}
+
+void addStats( struct cycleStats *total, struct cycleStats stats ) {
+	total->moves += stats.moves;
+	total->accepted += stats.accepted;
+	total->clash += stats.clash;
+	total->uphill += stats.uphill;
+	total->lecturer += stats.lecturer;
+	total->same += stats.same;
+}
+
+/* One line of newData.txt, for the level just done at temp */
+void logLevel( struct solver *solver, FILE *saveData, int level, double temp, float currentEnergy, float bestEnergy, struct cycleStats *stats ) {
+	fprintf(saveData, "%d,%g,%f,%f,%d,%d,%d,%d,%d,%d,%.3f\n", level, temp, currentEnergy, bestEnergy, stats->moves, stats->accepted, stats->clash, stats->uphill, stats->lecturer, stats->same, wallTime( solver ));
+	*stats = (struct cycleStats) { 0, 0, 0, 0, 0, 0 };
+}
+
+/* Checked each time the chain finds a new best. Only the first time it gets down to targetEnergy counts. */
+void noteTarget( struct chain *chain, float bestEnergy ) {
+	double targetEnergy = chain->solver->settings.targetEnergy;
+	if ( !isnan( targetEnergy ) && chain->targetTime < 0 && bestEnergy <= targetEnergy ) {
+		chain->targetTime = wallTime( chain->solver );
+	}
+}
+
+/* RETURNS the temperature to go to once a level at temp has been done, and stats says how it went. */
+double nextTemp( struct settings *settings, double temp, struct cycleStats stats ) {
+	switch ( settings->schedule ) {
+		case SCHEDULE_GEOMETRIC:
+			return temp * settings->cooling;
+		case SCHEDULE_ADAPTIVE:
+			if ( stats.accepted > settings->targetAccept * stats.moves ) {
+				return temp * settings->cooling;
+			}
+			return temp * sqrt( settings->cooling );
+	}
+	return temp - settings->coolStep;
+}
+
+/* The starting temperature is set so that a typical uphill move is accepted 80% of the time, i.e. exp(-mean uphill cost / temp) = 0.8.
+   The mean is taken over up to 100*cols sample moves from the starting configuration that break no constraints. Each is undone straight away. RETURNS the temperature */
+double calibrateTemp( struct chain *chain ) {
+	double uphill = 0;
+	float changeEnergy;
+	int i, count = 0;
+	for ( i = 0; i < 100 * chain->problem->cols; i++ ) {
+		proposeMove( chain );
+		changeEnergy = moveEnergy( chain );
+		if ( countViolations( &chain->ledger ) == 0 && changeEnergy > 0 ) {
+			uphill += changeEnergy;
+			count++;
+		}
+		undoMove( chain );
+	}
+	if ( count == 0 ) { /* no move the allocation can make costs anything, so any temperature will do */
+		return chain->solver->settings.endTemp;
+	}
+	return -( uphill / count ) / log( 0.8 );
+}
+
+/* currentEnergy is the running energy of the allocation. It is updated from the cost of each accepted move rather than recomputed, since a move only changes one or two pairs. */
+struct cycleStats cycleOfMoves( struct chain *chain, double temp ) {
+	struct solver *solver = chain->solver;
+	struct supervisors *sups = &chain->problem->sups;
+	int cols = chain->problem->cols;
+	int driftCheck = solver->settings.driftCheck;
+	struct randStream *rng = &chain->rng;
+	int *projNum = chain->projNum;
+	int *projPref = chain->projPref;
+	struct ledger *ledger = &chain->ledger;
+	struct move *move = &chain->move;
+	float *currentEnergy = &chain->currentEnergy;
+	int successfulmoves = 0;
+	int moves = 0;
+	int same = 0;
+	int clash = 0, uphill = 0, lecturer = 0; /* rejections, by reason */
+	float trialEnergy, fullEnergy;
+	float changeEnergy;
+	int lecClashes;
+	int i, moved;
+	struct cycleStats stats;
+
+	if ( solver->kernel != KERNEL_OFF && solver->settings.moveMix[MOVE_SWAP] == 0 && solver->settings.moveMix[MOVE_EJECT] == 0 ) { /* blocks only know single moves */
+		return cycleOfMovesBlocked( chain, temp );
+	}
+	while ( moves < ( 1000 * cols ) && successfulmoves < ( 100 * cols ) ) { 
+		if ( moves % CLOCK_EVERY == 0 && pastDeadline( chain ) ) { /* out of time part way through the level */
+			break;
+		}
+		moves++;
+		successfulmoves++; 
+		/* change the allocation here */
+		proposeMove( chain );
+		moved = move->moved; /* undoMove clears it */
+
+		//printf(" weight 1: %f, weight 2: %f, weight 3: %f, weight 4: %f\n", weight1, weight2, weight3, weight4);
+		/* only the pairs in the move have moved, so the cost of the move is just the difference between their new and old preferences */
+		changeEnergy = moveEnergy( chain );
+		trialEnergy = *currentEnergy + changeEnergy; /* energy of our new allocation */
+		//printf("current energy and trial energy, %d, %d\n", *currentEnergy, trialEnergy);
+
+		lecClashes = 0; /* only the new projects' supervisors can have gone over */
+		for ( i = 0; i < move->moved; i++ ) {
+			lecClashes += countSupConstraintClashes( sups, ledger, projNum[move->pair[i]] );
+		}
+
+		if ( ledger->clashCount > 0 ) { /* Reject configuration due to clash - revert changes and reduce succesful move counter */
+			undoMove( chain );
+
+			successfulmoves--;
+			clash++;
+		//	printf("ttttttttttttttthere was a clash\n");
+		} else if (temp > 0 && randUniform( rng ) > exp( -changeEnergy / temp ) ) { /* Reject configuration due to energy - revert changes */
+			undoMove( chain );
+			successfulmoves--;
+			uphill++;
+		//	printf("reject due to energy\n");
+
+		} else if ( temp == 0 && trialEnergy > *currentEnergy){ /* Reject due to energy in T=0 case */
+
+			undoMove( chain );
+			successfulmoves--;
+			uphill++;
+		//	printf("reject due to energy\n");
+		} else if ( lecClashes>0 ) { /* reject due to lecturer constraint violation */
+			undoMove( chain );
+			successfulmoves--;
+			lecturer++;
+		//	printf("reject due to lecturers\n");
+		} else { /* accepted - the running energy takes the cost of the move */
+			*currentEnergy = trialEnergy;
+		}
+			
+		if ( moved == 0 ) { /* The move came to nothing, e.g. the pair did not give the preference picked. Not counted as a success. */
+			//printf("This shouldn't be happening?\n\n");
+			same++;
+			successfulmoves--;
+		}	
+		
+		if ( driftCheck > 0 && moves % driftCheck == 0 ) { /* optional check that the running energy has not drifted from the true one through rounding */
+			fullEnergy = energy( solver, projPref );
+			if ( fabs( fullEnergy - *currentEnergy ) > 1e-3 ) {
+				report( solver, "Running energy %f has drifted from full energy %f\n", *currentEnergy, fullEnergy);
+			}
+			*currentEnergy = fullEnergy;
+		}
+	}
+	stats.moves = moves;
+	stats.accepted = successfulmoves;
+	stats.clash = clash;
+	stats.uphill = uphill;
+	stats.lecturer = lecturer;
+	stats.same = same;
+	chain->moves += moves;
+	return stats;
+}
+
+
+/* RETURNS 1 if the chain has a deadline and it has gone, else 0 */
+int pastDeadline( struct chain *chain ) {
+	return chain->deadline > 0 && wallTime( chain->solver ) >= chain->deadline;
+}
+
+/* calculates energy of a given allocation. RETURNS energy */
+float energy( struct solver *solver, int projPref[] ) {
+	int i = 0;
+	float energy = 0;
+	for ( i=0; i<solver->problem->cols; i++ ) {
+		energy += prefEnergy( solver, projPref[i] );
+	}
+	
+	return energy;
+}
+
+/* energy of one pair having a project of preference pref. The weights are in here. RETURNS energy */
+float prefEnergy( struct solver *solver, int pref ) {
+	return -solver->weight[pref];
+}
+
+/* Fills the ledger from scratch: how many pairs are on each project, how many clashes there are, and how much work each lecturer has.
+   After this, movePair keeps it up to date so this only needs doing once. */
+void rebuildLedger( struct chain *chain ) {
+	struct problem *problem = chain->problem;
+	struct supervisors *sups = &problem->sups;
+	struct ledger *ledger = &chain->ledger;
+	int *projNum = chain->projNum;
+	int i;
+	ledger->clashCount = 0;
+	ledger->lecOver = 0;
+	for ( i = 0; i < problem->rows; i++ ) {
+		ledger->projOcc[i] = 0;
+	}
+	for ( i = 0; i < problem->numLec; i++ ) {
+		ledger->lecLoad[i] = 0;
+	}
+	for ( i = 0; i < problem->cols; i++ ) {
+		ledger->clashCount += ledger->projOcc[projNum[i]]; /* pair i clashes with every pair already on its project */
+		ledger->projOcc[projNum[i]]++;
+		changeLoad( sups, ledger, projNum[i], 1 );
+	}
+}
+
+/* A pair has joined (sign = 1) or left (sign = -1) project proj, so add or take its weighting from each of the project's supervisors, tracking who goes over unit workload. */
+void changeLoad( struct supervisors *sups, struct ledger *ledger, int proj, int sign ) {
+	int k, j, wasOver;
+	for( k = sups->projStart[proj]; k < sups->projStart[proj+1]; k++ ) {
+		j = sups->lec[k];
+		wasOver = ledger->lecLoad[j] > 1 + LOAD_TOLERANCE;
+		ledger->lecLoad[j] += sign * sups->weight[k];
+		ledger->lecOver += ( ledger->lecLoad[j] > 1 + LOAD_TOLERANCE ) - wasOver;
+	}
+}
+
+/* Moves pair from its current project to proj, which is its preference pref. Every change to the allocation goes through here so the ledger stays right. */
+void movePair( struct chain *chain, int pair, int proj, int pref ) {
+	struct supervisors *sups = &chain->problem->sups;
+	struct ledger *ledger = &chain->ledger;
+	int *projNum = chain->projNum;
+	int *projOcc = ledger->projOcc;
+	projOcc[projNum[pair]]--;
+	ledger->clashCount -= projOcc[projNum[pair]]; /* it no longer clashes with the pairs left on its old project */
+	ledger->clashCount += projOcc[proj]; /* but does with any already on its new one */
+	projOcc[proj]++;
+	changeLoad( sups, ledger, projNum[pair], -1 );
+	changeLoad( sups, ledger, proj, 1 );
+	projNum[pair] = proj;
+	chain->projPref[pair] = pref;
+}
+
+/* important number generator thingy. Seeds the stream's own generator ONCE and makes the first buffer of numbers. ranvec.c has no streams, so stream i is just seeded seed+i */
+void initRandStream( struct randStream *rng, int generator, long int seed, int stream, struct arena *arena ) {
+	rng->generator = generator;
+	rng->gen.array1 = NULL;
+	rng->gen.array2 = NULL;
+	rng->buffer = arenaAlloc( arena, RAND_BUFFER * sizeof(int) );
+	if ( generator == RNG_PHILOX ) {
+		initPhilox( &rng->philox, seed, stream );
+	} else {
+		init_vector_random_generator_r( &rng->gen, seed + stream, RAND_BUFFER );
+	}
+	refillRandStream( rng );
+}
+
+/* Makes the next RAND_BUFFER numbers in one go. */
+void refillRandStream( struct randStream *rng ) {
+	if ( rng->generator == RNG_PHILOX ) {
+		philoxFill( &rng->philox, RAND_BUFFER, rng->buffer );
+	} else {
+		vector_random_generator_int_r( &rng->gen, RAND_BUFFER, rng->buffer );
+	}
+	rng->cursor = 0;
+}
+
+void freeRandStream( struct randStream *rng ) {
+	free_random_generator_r( &rng->gen );
+}
+
+/* takes the next number off the buffer, refilling it in one go when it has all been used. RETURNS an integer in [0,RAND_RANGE) */
+int randRaw( struct randStream *rng ) {
+	if ( rng->cursor == RAND_BUFFER ) {
+		refillRandStream( rng );
+	}
+	return rng->buffer[rng->cursor++];
+}
+
+/* RETURNS a random number in [0,1) */
+double randUniform( struct randStream *rng ) {
+	return randRaw( rng ) / RAND_RANGE;
+}
+
+/* RETURNS a random integer between 0 and n-1. Numbers from the top of the range that would make some answers more likely than others are thrown away and drawn again. */
+int randInt( struct randStream *rng, int n ) {
+	long int limit = (long int) RAND_RANGE - ( (long int) RAND_RANGE % n ); /* the largest multiple of n in range */
+	long int r;
+	do {
+		r = randRaw( rng );
+	} while ( r >= limit );
+	return (int) ( r % n );
+}
+
+/* Fills out with count random integers between 0 and n-1, every value equally likely, without randInt's divisions: each is the top of r*n, with the few r whose bottom would make some answers more likely than others thrown away and drawn again. */
+void randInts( struct randStream *rng, int n, int count, int out[] ) {
+	long int threshold = (long int) RAND_RANGE % n; /* the only division */
+	long int scaled;
+	int i;
+	for ( i = 0; i < count; i++ ) {
+		do {
+			scaled = (long int) randRaw( rng ) * n;
+		} while ( ( scaled & ( (long int) RAND_RANGE - 1 ) ) < threshold );
+		out[i] = (int) ( scaled >> 31 );
+	}
+}
+
+/* Picks a kind of move, with the chances set by moveMix, and makes it. The move is left in chain->move.
+   single - one pair moves to another of its choices (changeAllocationByPref). At low temperature this is nearly always to a project that is taken, and is rejected.
+   swap - one pair moves to another of its choices, and the pair that had it takes the first pair's old project (swapPairs). Only the pairs change, not which projects are taken, so this can never break a constraint.
+   eject - one pair moves to another of its choices, and the pair that had it moves on to one of its other choices (ejectPair). */
+void proposeMove( struct chain *chain ) {
+	double *moveMix = chain->solver->settings.moveMix;
+	double r;
+	if ( moveMix[MOVE_SWAP] == 0 && moveMix[MOVE_EJECT] == 0 ) { /* no need for a random number to pick */
+		changeAllocationByPref( chain );
+		return;
+	}
+	r = randUniform( &chain->rng ) * ( moveMix[MOVE_SINGLE] + moveMix[MOVE_SWAP] + moveMix[MOVE_EJECT] );
+	if ( r < moveMix[MOVE_SINGLE] ) {
+		changeAllocationByPref( chain );
+	} else if ( r < moveMix[MOVE_SINGLE] + moveMix[MOVE_SWAP] ) {
+		swapPairs( chain );
+	} else {
+		ejectPair( chain );
+	}
+}
+
+/* This functions CHANGES THE ALLOCATION. Based on picking a pair, and then picking a project, and then making the change. Stores the change nicely in move.*/
+void changeAllocationByPref( struct chain *chain ) {
+	struct choices *choices = &chain->problem->choices;
+	int *projPref = chain->projPref;
+	int pair, pref;
+	
+	pair = randInt( &chain->rng, chain->problem->cols );
+	//printf("\npair current pref is %d\n", projPref[pair]);
+
+	/* avoid picking same preference - waste of a move and time. So pick one of the other NUMPREFS-1 and skip over the current one. pref is in [0,3] and projPref in [1,4] */
+	pref = randInt( &chain->rng, NUMPREFS - 1 );
+	if ( pref >= projPref[pair] - 1 ) {
+		pref++;
+	}
+	//printf("chosen pref is %d\n", pref+1);
+	chain->move.moved = 0;
+	//printf("Energy before reallocation is %d\n", energy(projPref));
+	/* make the change. If the pair did not give this preference, nothing changes. */
+	if( choices->prefProj[pair][pref] >= 0 ) {
+		shiftPair( chain, pair, choices->prefProj[pair][pref], pref+1 );
+	}
+	//printf("Energy after reallocation is %d\n", energy(projPref));
+
+}
+
+/* Picks a pair and another of its choices as changeAllocationByPref does. If a pair already has that project, it takes the first pair's old project instead - but only if it chose it too.
+   If nobody has the project, the first pair just moves there. */
+void swapPairs( struct chain *chain ) {
+	struct choices *choices = &chain->problem->choices;
+	int *projNum = chain->projNum;
+	struct move *move = &chain->move;
+	int pair, pref, other, otherPref, proj, oldProj;
+
+	changeAllocationByPref( chain );
+	if ( move->moved == 0 ) {
+		return;
+	}
+	pair = move->pair[0];
+	proj = projNum[pair];
+	oldProj = move->proj[0];
+	other = holderOf( choices, projNum, proj, pair );
+	if ( other < 0 ) {
+		return;
+	}
+	for ( pref = 0; pref < NUMPREFS; pref++ ) {
+		if ( choices->prefProj[other][pref] == oldProj ) {
+			break;
+		}
+	}
+	if ( pref == NUMPREFS ) { /* the other pair did not choose the first pair's project, so the swap cannot happen */
+		undoMove( chain );
+		return;
+	}
+	otherPref = pref + 1;
+	shiftPair( chain, other, oldProj, otherPref );
+}
+
+/* Picks a pair and another of its choices as changeAllocationByPref does. If a pair already has that project, it is moved on to one of its own other choices, picked at random.
+   That may be taken too, in which case the move will be rejected, as a single move would. If nobody has the project, the first pair just moves there. */
+void ejectPair( struct chain *chain ) {
+	struct choices *choices = &chain->problem->choices;
+	int *projNum = chain->projNum;
+	struct move *move = &chain->move;
+	int other, pref;
+
+	changeAllocationByPref( chain );
+	if ( move->moved == 0 ) {
+		return;
+	}
+	other = holderOf( choices, projNum, projNum[move->pair[0]], move->pair[0] );
+	if ( other < 0 ) {
+		return;
+	}
+	/* as in changeAllocationByPref, pick one of the other NUMPREFS-1 preferences */
+	pref = randInt( &chain->rng, NUMPREFS - 1 );
+	if ( pref >= chain->projPref[other] - 1 ) {
+		pref++;
+	}
+	if ( choices->prefProj[other][pref] < 0 ) { /* the other pair did not give this preference, so it has nowhere to go */
+		undoMove( chain );
+		return;
+	}
+	shiftPair( chain, other, choices->prefProj[other][pref], pref+1 );
+}
+
+/* Moves pair to proj, which is its preference pref, and adds it to the move so it can be undone. */
+void shiftPair( struct chain *chain, int pair, int proj, int pref ) {
+	struct move *move = &chain->move;
+	move->pair[move->moved] = pair;
+	move->proj[move->moved] = chain->projNum[pair];
+	move->pref[move->moved] = chain->projPref[pair];
+	move->moved++;
+	movePair( chain, pair, proj, pref );
+}
+
+/* Undoes the move, last pair first, and marks it as having come to nothing. */
+void undoMove( struct chain *chain ) {
+	struct move *move = &chain->move;
+	while ( move->moved > 0 ) {
+		move->moved--;
+		movePair( chain, move->pair[move->moved], move->proj[move->moved], move->pref[move->moved] );
+	}
+}
+
+/* RETURNS the energy after the move less the energy before it. Only the pairs that moved count. */
+float moveEnergy( struct chain *chain ) {
+	struct move *move = &chain->move;
+	float change = 0;
+	int i;
+	for ( i = 0; i < move->moved; i++ ) {
+		change += prefEnergy( chain->solver, chain->projPref[move->pair[i]] ) - prefEnergy( chain->solver, move->pref[i] );
+	}
+	return change;
+}
+
+/* RETURNS a pair other than pair whose project is proj, or -1 if there is none. Only the pairs who chose proj need looking at. */
+int holderOf( struct choices *choices, int projNum[], int proj, int pair ) {
+	int k, chooser;
+	for ( k = choices->chooserStart[proj]; k < choices->chooserStart[proj+1]; k++ ) {
+		chooser = choices->chooser[k];
+		if ( chooser != pair && projNum[chooser] == proj ) {
+			return chooser;
+		}
+	}
+	return -1;
+}
+
+/* Does what it says. Both parts are kept in the ledger so this is just a lookup. RETURNS a count */
+int countViolations( struct ledger *ledger ) {
+	return ledger->clashCount + ledger->lecOver;
+}
+	
+/* counts how many of the supervisors of project proj are over unit workload. */
+int countSupConstraintClashes( struct supervisors *sups, struct ledger *ledger, int proj ){
+	int k; 
+	int clash = 0;
+	/* the ledger already has the sum of the weights of the allocated projects for every lecturer, so we only look at the supervisors proj has. If sum > 1, violation */
+	for( k = sups->projStart[proj]; k < sups->projStart[proj+1]; k++ ) {
+		if( ledger->lecLoad[sups->lec[k]] > 1 + LOAD_TOLERANCE ) { 
+			clash++;
+		}
+	}
+	return clash;
+}
+
+/* The pair's old project stops counting towards any supervisor the two share. RETURNS 1 if a supervisor of proj would go over unit workload, else 0 */
+int supervisorsOver( struct chain *chain, int oldProj, int proj ) {
+	struct supervisors *sups = &chain->problem->sups;
+	int i, j;
+	double load;
+	for ( i = sups->projStart[proj]; i < sups->projStart[proj+1]; i++ ) {
+		load = chain->ledger.lecLoad[sups->lec[i]] + sups->weight[i];
+		for ( j = sups->projStart[oldProj]; j < sups->projStart[oldProj+1]; j++ ) {
+			if ( sups->lec[j] == sups->lec[i] ) {
+				load -= sups->weight[j];
+			}
+		}
+		if ( load > 1 + LOAD_TOLERANCE ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* create an initial configuration. Start at random, and then accept any change (again randomly determined) that reduces the number of constraints being violated. We are finished when no constraints are being vioalted.
+   RETURNS 0, or -1 if repairConfiguration gave up */
+int createInitialConfiguration( struct chain *chain ) {
+	struct choices *choices = &chain->problem->choices;
+	struct randStream *rng = &chain->rng;
+	int *projNum = chain->projNum;
+	int *projPref = chain->projPref;
+
+	int pref; /* integer from 1 to 4 */
+	int i; /* loop counter */
+	for ( i=0; i<chain->problem->cols; i++ ) {
+      
+		do { /* pick a preference the pair actually gave, and assign it */
+			pref = randInt( rng, NUMPREFS );
+		} while ( choices->prefProj[i][pref] < 0 );
+		projNum[i] = choices->prefProj[i][pref];
+		projPref[i] = pref + 1;
+	}	
+	return repairConfiguration( chain );
+}
+
+/* Starting from whatever allocation the chain has, moves pairs about at random, never letting the number of violations go up, until there are none.
+   Gives up once REPAIR_STALL moves a pair in a row have not lowered the count, which where the supervisors cannot take every pair would be never, or once the solver is
+   interrupted or the chain is out of time. Those are only looked at every CLOCK_EVERY moves. RETURNS 0 once nothing is violated, or -1 if it gave up */
+int repairConfiguration( struct chain *chain ) {
+	struct ledger *ledger = &chain->ledger;
+	struct solver *solver = chain->solver;
+	int violationCount1, violationCount2; /* count number of violations. 1 is "old", 2 is "current" */
+	long int moves = 0;
+	long int stall = 0; /* moves since the count last went down */
+	long int limit = (long int) REPAIR_STALL * chain->problem->cols;
+
+	rebuildLedger( chain );
+	
+	violationCount1 = countViolations( ledger );
+	while( violationCount1 > 0 ){
+	  //	  printf("violationCount1=%i\n",violationCount1);
+
+		changeAllocationByPref( chain );
+		moves++;
+		violationCount2 = countViolations( ledger );
+		if( violationCount2 > violationCount1 ) { /* In this case, the number of violations has INCREASED, so we REJECT it and REVERT to the old allocation. */
+			undoMove( chain );
+			stall++;
+		} else { /* update violationCount1 */	
+			stall = violationCount2 < violationCount1 ? 0 : stall + 1;
+			violationCount1 = violationCount2; 
+		}
+		if ( stall >= limit ) {
+			return -1;
+		}
+		if ( moves % CLOCK_EVERY == 0 && ( solver->interrupted || pastDeadline( chain ) ) ) {
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "libspa.h"
+
+/************************************************************************************************************/
+/*  Batch mode: solves every problem listed in a manifest, several at once.                                 */
+/*    Each line of the manifest is one job:                                                                 */
+/*        name choices.csv supervisors.csv [seed] [score1,score2,score3,score4]                             */
+/*    separated by spaces. Blank lines and lines starting with # are skipped. A seed of 0, or none, uses    */
+/*    the run's seed plus the number of jobs before it, and the scores default to those in spaDefaults.     */
+/*    A supervisors file of - means choices.csv is a compiled instance (see instance.c), mapped in instead. */
+/*    Every job is annealed with the options given on the command line.                                     */
+/*    Each job writes name_finalConfig.txt, name_newData.txt and its output to name.log, and once they are  */
+/*    all done a line for each goes in batchSummary.txt.                                                    */
+/*    Only the library (libspa.h) is used, and a solver shares nothing with any other, so the jobs are      */
+/*    solved on a pool of numWorkers threads, each taking the next job nobody has started until there are   */
+/*    none left. Every pair of files is read in before any job starts, only once however many jobs use it,  */
+/*    and the jobs using it all share the one problem.                                                      */
+/************************************************************************************************************/
+
+#define MANIFEST_LINE 4096 /* longest line of a manifest */
+
+/* One line of the manifest. */
+struct job {
+	char *name;
+	int problem; /* which of the problems it is */
+	long int seed;
+	int scored; /* 1 if it has scores of its own */
+	float score[NUMPREFS];
+	struct result result;
+};
+
+/* The pairs of files the jobs use, each read in once. */
+struct problems {
+	int count;
+	int capacity;
+	char **choicesName;
+	char **supervisorsName;
+	struct problem **problem; /* NULL if it could not be read */
+	char **loadError; /* if so, why, for the logs of the jobs using it */
+};
+
+/* Everything the threads share. */
+struct batch {
+	struct job *jobList;
+	int numJobs;
+	struct problems *problems; /* read only */
+	struct settings *settings; /* read only. Each job makes its own copy */
+	int next; /* the next job to be started */
+	pthread_mutex_t lock; /* guards next */
+};
+
+int readManifest( char *manifest, long int seed, struct job **jobList, struct problems *problems ); /* RETURNS how many jobs there are, or -1 */
+int findProblem( struct problems *problems, char *choicesName, char *supervisorsName ); /* reads in the pair of files if they have not been already. RETURNS which problem it is */
+void *runJobs( void *arg ); /* the work of one thread */
+int runJob( struct batch *batch, struct job *job, int number ); /* solves one job. RETURNS 0, or -1 if it could not write its log */
+
+int runBatch( char *manifest, int numWorkers, struct settings *settings ) {
+	struct batch batch;
+	struct problems problems = { 0, 0, NULL, NULL, NULL, NULL };
+	struct job *job;
+	pthread_t *pool;
+	FILE *summary;
+	int numJobs, failures = 0;
+	int i;
+
+	numJobs = readManifest( manifest, settings->seed, &batch.jobList, &problems );
+	if ( numJobs < 0 ) {
+		return 1;
+	}
+	if ( numWorkers == 0 ) {
+		numWorkers = (int) sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	if ( numWorkers < 1 ) {
+		numWorkers = 1;
+	}
+	if ( numWorkers > numJobs ) { /* no point having more threads than jobs */
+		numWorkers = numJobs > 0 ? numJobs : 1;
+	}
+	batch.numJobs = numJobs;
+	batch.problems = &problems;
+	batch.settings = settings;
+	batch.next = 0;
+	pthread_mutex_init( &batch.lock, NULL );
+	printf("Batch: %d jobs, %d at a time\n", numJobs, numWorkers);
+
+	pool = malloc( numWorkers * sizeof(pthread_t) );
+	if ( pool == NULL ) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for ( i = 0; i < numWorkers; i++ ) {
+		if ( pthread_create( &pool[i], NULL, runJobs, &batch ) != 0 ) {
+			fprintf(stderr, "Could not start thread %d\n", i);
+			exit(1);
+		}
+	}
+	for ( i = 0; i < numWorkers; i++ ) {
+		pthread_join( pool[i], NULL );
+	}
+	pthread_mutex_destroy( &batch.lock );
+	free( pool );
+
+	summary = fopen( "batchSummary.txt", "w" );
+	if ( summary == NULL ) {
+		fprintf(stderr, "Could not write batchSummary.txt\n");
+		return 1;
+	}
+	fprintf(summary, "job,choicesFile,supervisorsFile,seed,pairs,projects,supervisors,energy,bound,gap,moves,seconds\n");
+	for ( i = 0; i < numJobs; i++ ) {
+		job = &batch.jobList[i];
+		fprintf(summary, "%s,%s,%s,%ld,", job->name, problems.choicesName[job->problem], problems.supervisorsName[job->problem], job->seed);
+		if ( job->result.status != 0 ) {
+			fprintf(summary, ",,,failed,,,,\n");
+			failures++;
+		} else if ( job->result.bound > -HUGE_VAL ) {
+			fprintf(summary, "%d,%d,%d,%f,%f,%f,%ld,%.3f\n", job->result.pairs, job->result.projects, job->result.supervisors, job->result.energy, job->result.bound, job->result.energy - job->result.bound, job->result.moves, job->result.seconds);
+		} else {
+			fprintf(summary, "%d,%d,%d,%f,,,%ld,%.3f\n", job->result.pairs, job->result.projects, job->result.supervisors, job->result.energy, job->result.moves, job->result.seconds);
+		}
+	}
+	fclose( summary );
+	printf("%d of %d jobs solved, summary in batchSummary.txt\n", numJobs - failures, numJobs);
+
+	for ( i = 0; i < problems.count; i++ ) {
+		if ( problems.problem[i] != NULL ) {
+			spaFreeProblem( problems.problem[i] );
+		}
+		free( problems.choicesName[i] );
+		free( problems.supervisorsName[i] );
+		free( problems.loadError[i] );
+	}
+	for ( i = 0; i < numJobs; i++ ) {
+		free( batch.jobList[i].name );
+	}
+	free( batch.jobList );
+	free( problems.choicesName );
+	free( problems.supervisorsName );
+	free( problems.problem );
+	free( problems.loadError );
+	return failures > 0;
+}
+
+/* Reads every job in, and every pair of files they use. Files that cannot be read fail the jobs using them, but not the batch. */
+int readManifest( char *manifest, long int seed, struct job **jobList, struct problems *problems ) {
+	FILE *file;
+	char line[MANIFEST_LINE];
+	char *name, *choices, *sups, *seedText, *scores, *end;
+	struct job *job;
+	int numJobs = 0, capacity = 0, lineNumber = 0, i;
+
+	file = fopen( manifest, "r" );
+	if ( file == NULL ) {
+		fprintf(stderr, "Could not open %s\n", manifest);
+		return -1;
+	}
+	*jobList = NULL;
+	while ( fgets( line, sizeof(line), file ) != NULL ) {
+		lineNumber++;
+		name = strtok( line, " \t\r\n" );
+		if ( name == NULL || name[0] == '#' ) {
+			continue;
+		}
+		choices = strtok( NULL, " \t\r\n" );
+		sups = strtok( NULL, " \t\r\n" );
+		seedText = strtok( NULL, " \t\r\n" );
+		scores = strtok( NULL, " \t\r\n" );
+		if ( sups == NULL || strtok( NULL, " \t\r\n" ) != NULL ) {
+			fprintf(stderr, "%s line %d: need name choices.csv supervisors.csv [seed] [scores]\n", manifest, lineNumber);
+			fclose( file );
+			return -1;
+		}
+		for ( i = 0; i < numJobs; i++ ) {
+			if ( strcmp( (*jobList)[i].name, name ) == 0 ) {
+				fprintf(stderr, "%s line %d: there is already a job called %s\n", manifest, lineNumber, name);
+				fclose( file );
+				return -1;
+			}
+		}
+		if ( numJobs == capacity ) {
+			capacity = capacity ? 2 * capacity : 16;
+			*jobList = realloc( *jobList, capacity * sizeof(struct job) );
+			if ( *jobList == NULL ) {
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+		}
+		job = &(*jobList)[numJobs];
+		job->name = strdup( name );
+		job->result.status = -1;
+		job->seed = ( seedText != NULL ) ? strtol( seedText, &end, 10 ) : 0;
+		if ( seedText != NULL && ( *end != '\0' || job->seed < 0 ) ) {
+			fprintf(stderr, "%s line %d: the seed should be a whole number, 0 or more\n", manifest, lineNumber);
+			fclose( file );
+			return -1;
+		}
+		if ( job->seed == 0 ) {
+			job->seed = seed + numJobs;
+		}
+		job->scored = ( scores != NULL );
+		if ( scores != NULL && sscanf( scores, "%f,%f,%f,%f", &job->score[0], &job->score[1], &job->score[2], &job->score[3] ) != NUMPREFS ) {
+			fprintf(stderr, "%s line %d: the scores should be four numbers, e.g. 4.7,4.15,3,2.35\n", manifest, lineNumber);
+			fclose( file );
+			return -1;
+		}
+		job->problem = findProblem( problems, choices, sups );
+		numJobs++;
+	}
+	fclose( file );
+	return numJobs;
+}
+
+int findProblem( struct problems *problems, char *choicesName, char *supervisorsName ) {
+	char error[ERROR_LENGTH];
+	int i;
+	for ( i = 0; i < problems->count; i++ ) {
+		if ( strcmp( problems->choicesName[i], choicesName ) == 0 && strcmp( problems->supervisorsName[i], supervisorsName ) == 0 ) {
+			return i;
+		}
+	}
+	if ( problems->count == problems->capacity ) {
+		problems->capacity = problems->capacity ? 2 * problems->capacity : 16;
+		problems->choicesName = realloc( problems->choicesName, problems->capacity * sizeof(char *) );
+		problems->supervisorsName = realloc( problems->supervisorsName, problems->capacity * sizeof(char *) );
+		problems->problem = realloc( problems->problem, problems->capacity * sizeof(struct problem *) );
+		problems->loadError = realloc( problems->loadError, problems->capacity * sizeof(char *) );
+		if ( problems->choicesName == NULL || problems->supervisorsName == NULL || problems->problem == NULL || problems->loadError == NULL ) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	i = problems->count++;
+	problems->choicesName[i] = strdup( choicesName ); /* kept for the summary, as the line they are in gets read over */
+	problems->supervisorsName[i] = strdup( supervisorsName );
+	if ( strcmp( supervisorsName, "-" ) == 0 ) {
+		problems->problem[i] = spaLoadCompiled( choicesName, error );
+	} else {
+		problems->problem[i] = spaLoadProblem( choicesName, supervisorsName, error );
+	}
+	problems->loadError[i] = NULL;
+	if ( problems->problem[i] == NULL ) {
+		fprintf(stderr, "%s\n", error);
+		problems->loadError[i] = strdup( error );
+	}
+	return i;
+}
+
+/* One thread of the pool. Keeps taking the next job and solving it until there are none left. */
+void *runJobs( void *arg ) {
+	struct batch *batch = arg;
+	int i;
+
+	for ( ;; ) {
+		pthread_mutex_lock( &batch->lock );
+		i = batch->next++;
+		pthread_mutex_unlock( &batch->lock );
+		if ( i >= batch->numJobs ) {
+			return NULL;
+		}
+		if ( runJob( batch, &batch->jobList[i], i ) != 0 ) {
+			printf("Job %s failed, as %s.log could not be written\n", batch->jobList[i].name, batch->jobList[i].name);
+		} else if ( batch->jobList[i].result.status == 0 ) {
+			printf("Job %s: energy %f in %.3f s\n", batch->jobList[i].name, batch->jobList[i].result.energy, batch->jobList[i].result.seconds);
+		} else {
+			printf("Job %s failed, see %s.log\n", batch->jobList[i].name, batch->jobList[i].name);
+		}
+	}
+}
+
+/* Solves one job with its own solver, with everything it prints going to its log. If its problem could not be read, the log says why. */
+int runJob( struct batch *batch, struct job *job, int number ) {
+	struct problem *problem = batch->problems->problem[job->problem];
+	struct settings settings = *batch->settings;
+	struct solver *solver;
+	char fileName[FILENAME_MAX], dataName[FILENAME_MAX], summaryName[FILENAME_MAX];
+	char error[ERROR_LENGTH];
+	FILE *log;
+
+	snprintf( fileName, sizeof(fileName), "%s.log", job->name );
+	log = fopen( fileName, "w" );
+	if ( log == NULL ) {
+		return -1;
+	}
+	if ( problem == NULL ) {
+		fprintf(log, "Job %s (%d): %s\n", job->name, number + 1, batch->problems->loadError[job->problem]);
+		fclose( log );
+		return 0;
+	}
+	settings.seed = job->seed;
+	if ( job->scored ) {
+		memcpy( settings.score, job->score, sizeof(settings.score) );
+	}
+	snprintf( summaryName, sizeof(summaryName), "%s_chainSummary.txt", job->name );
+	settings.chainSummary = summaryName;
+	fprintf(log, "Job %s (%d): %s and %s, seed %ld\n", job->name, number + 1, batch->problems->choicesName[job->problem], batch->problems->supervisorsName[job->problem], settings.seed);
+	snprintf( fileName, sizeof(fileName), "%s_finalConfig.txt", job->name );
+	snprintf( dataName, sizeof(dataName), "%s_newData.txt", job->name );
+	remove( fileName ); /* spaWriteAllocation adds on to it */
+	solver = spaNewSolver( problem, &settings, log, error );
+	if ( solver == NULL ) {
+		fprintf(log, "%s\n", error);
+		fclose( log );
+		return 0;
+	}
+	if ( spaSolve( solver, dataName, error ) != 0 ) {
+		fprintf(log, "%s\n", error);
+	} else if ( spaWriteAllocation( solver, fileName ) != 0 ) {
+		fprintf(log, "Could not write %s\n", fileName);
+	} else {
+		spaGetResult( solver, &job->result );
+	}
+	spaFreeSolver( solver );
+	fclose( log );
+	return 0;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Scaling benchmark, run by  make bench
+# Generates a synthetic instance of each size in SIZES (pairs:projects:lecturers), then solves it and each of the
+# bundled datasets with the same seed and options, and reports the moves per second, the time taken to get down to
+# the energy TARGET and the peak memory. Moves per second counts the moves rejection-free sampling skips over.
+# The time to the target is read off newData.txt rather than given as --target-energy, which would stop the run there.
+# Any of SIZES, TARGET and OPTIONS can be set in the environment, e.g.
+#   SIZES="5000:15000:5000" OPTIONS="--seed 2 --schedule geometric --cooling 0.9" make bench
+
+SIZES=${SIZES:-"100:300:100 400:1200:400 1600:4800:1600"}
+TARGET=${TARGET:--85}
+OPTIONS=${OPTIONS:-"--seed 1 --schedule adaptive --tstart auto --frozen 30"}
+
+here=$(pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+printf "%-24s %6s %6s %6s %12s %10s %10s %10s %10s\n" instance pairs projs lecs moves/s time_s target_s energy peak_kB
+
+# solve NAME CHOICES SUPERVISORS. spa.out is run in the work directory so its output files go there
+solve() {
+	( cd "$work" && "$here/spa.out" $OPTIONS "$2" "$3" > out.txt ) || { echo "$1 failed"; return 1; }
+	target=$(awk -F, -v target="$TARGET" 'NR > 1 && $4 <= target { print $11; exit }' "$work/newData.txt")
+	awk -v name="$1" -v target="$target" '
+		/ projects, .* pairs, .* supervisors/ { projs = $1; pairs = $3; lecs = $5 }
+		/^Final energy is/ { energy = $4 }
+		/ moves in .* moves per second/ { time = $4; rate = $6 }
+		/^Peak memory/ { peak = $3 }
+		END { printf "%-24s %6s %6s %6s %12s %10s %10s %10s %10s\n", name, pairs, projs, lecs, rate, time, target == "" ? "-" : target, energy, peak }
+	' "$work/out.txt"
+}
+
+for size in $SIZES; do
+	set -- $(echo "$size" | tr ':' ' ')
+	"$here/generate.out" --seed 1 "$1" "$2" "$3" "$work/synthetic" > /dev/null || exit 1
+	solve "synthetic $size" "$work/synthetic_choices.csv" "$work/synthetic_supervisors.csv" || exit 1
+done
+for d in 1 2 3 4; do
+	solve "Dataset$d" "$here/Dataset${d}CSV.csv" "$here/LecturersDataset${d}CSV.csv" || exit 1
+done
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include "spa.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+/************************************************************************************************************/
+/*  Single moves priced in blocks.                                                                          */
+/*    cycleOfMoves makes every move it tries, looks at the ledger and undoes it again, one at a time. But   */
+/*    at all but the highest temperatures nearly every single move is rejected, most because the project is */
+/*    taken. So here a block of candidate moves (a pair, and which of its other preferences) is drawn in    */
+/*    one go, and all of them are priced together without making any: the project each would go to, whether */
+/*    it is taken and the change in energy. That is a few gathers and compares per move, laid out as arrays */
+/*    so it can be done 8 (AVX2) or 4 (SSE) moves at a time. Then they are gone through in order as         */
+/*    cycleOfMoves would, only the ones with a free project having the energy and supervisors looked at,    */
+/*    and only an accepted one actually being made. An accepted move changes the allocation the rest were   */
+/*    priced against, so the rest are priced again, a few at a time, as they are needed.                    */
+/*    The supervisor workloads are not part of the pricing: supervisorsOver checks them, one move at a      */
+/*    time, for the few moves that get that far (a free project, and the energy accepted). Doing it in the  */
+/*    kernels would mean checking every move in the block, nearly all of whose projects are taken, and each */
+/*    project has its own number of supervisors (its run of the CSR links), some shared with the pair's old */
+/*    project, which does not lay out in lanes. So the kernels only do the part every move needs.           */
+/*    The clash and supervisor checks are the same as nfold.c makes, and every kernel works out exactly the */
+/*    same numbers, so which one is used makes no difference to the run. The kernel is picked when the      */
+/*    solver is made, as asked for (if the CPU can do it), or with auto by timing them all on the chain's   */
+/*    first block. Gathers are slow on some CPUs, so the widest is not always the quickest.                 */
+/************************************************************************************************************/
+
+#define PRICE_FIRST 8 /* how many moves are priced after one has been accepted. Doubles each time they are all used up */
+
+void drawMoves( struct chain *chain, int count ); /* fills the block with candidate moves */
+void priceMoves( struct chain *chain, int kernel, int from, int to ); /* prices moves from to to-1 with kernel */
+int timeKernels( struct chain *chain ); /* the quickest kernel on the block */
+void priceMovesScalar( struct chain *chain, int from, int to );
+#ifdef HAVE_X86
+void priceMovesSSE( struct chain *chain, int from, int to );
+void priceMovesAVX2( struct chain *chain, int from, int to );
+#endif
+
+const char *kernelNames[] = { "off", "scalar", "sse", "avx2", "auto" }; /* by KERNEL_ */
+
+size_t moveBlockBytes( void ) {
+	return 5 * ARENA_ROUND( MOVE_BLOCK * sizeof(int) ) + ARENA_ROUND( MOVE_BLOCK * sizeof(float) );
+}
+
+void allocMoveBlock( struct moveBlock *block, struct arena *arena ) {
+	int size = MOVE_BLOCK;
+	block->pair = arenaAlloc( arena, size * sizeof(int) );
+	block->skip = arenaAlloc( arena, size * sizeof(int) );
+	block->pref = arenaAlloc( arena, size * sizeof(int) );
+	block->proj = arenaAlloc( arena, size * sizeof(int) );
+	block->verdict = arenaAlloc( arena, size * sizeof(int) );
+	block->change = arenaAlloc( arena, size * sizeof(float) );
+}
+
+/* RETURNS kernel if the CPU can run it, or -1 if it cannot. off, scalar and auto can always be run */
+int checkKernel( int kernel ) {
+#ifdef HAVE_X86
+	__builtin_cpu_init();
+	if ( ( kernel == KERNEL_AVX2 && !__builtin_cpu_supports( "avx2" ) ) || ( kernel == KERNEL_SSE && !__builtin_cpu_supports( "sse2" ) ) ) {
+		return -1;
+	}
+	return kernel;
+#else
+	return ( kernel == KERNEL_SSE || kernel == KERNEL_AVX2 ) ? -1 : kernel;
+#endif
+}
+
+/* Does all the moves for a fixed temp, as cycleOfMoves does with single moves only, and goes the same way as far as the numbers go: the same budget, checks and stats.
+   The random numbers are drawn in a different order, so a seed does not give the same run as with KERNEL_OFF. */
+struct cycleStats cycleOfMovesBlocked( struct chain *chain, double temp ) {
+	struct solver *solver = chain->solver;
+	struct moveBlock *block = &chain->block;
+	int cols = chain->problem->cols;
+	int driftCheck = solver->settings.driftCheck;
+	float *currentEnergy = &chain->currentEnergy;
+	int successfulmoves = 0;
+	int moves = 0;
+	int budget = 1000 * cols;
+	int outright[2] = { 0, 0 }; /* moves that came to nothing, and were rejected for a clash, by BLOCK_SAME and BLOCK_CLASH */
+	int uphill = 0, lecturer = 0; /* the other rejections */
+	int checked = 0; /* drift checks done */
+	int next = 0, drawn = 0, priced = 0, end; /* the next move to go through, how many are in the block, and how many of those are priced */
+	int batch = PRICE_FIRST; /* how many to price next time */
+	int clock = 0; /* moves made when the clock is next looked at */
+	float trialEnergy, fullEnergy;
+	int i, pair;
+	struct cycleStats stats;
+
+	while ( moves < budget && successfulmoves < ( 100 * cols ) ) {
+		if ( moves >= clock ) { /* moves go by in jumps here, so every CLOCK_EVERY or so */
+			if ( pastDeadline( chain ) ) {
+				break;
+			}
+			clock = moves + CLOCK_EVERY;
+		}
+		if ( next == drawn ) {
+			drawMoves( chain, MOVE_BLOCK );
+			drawn = MOVE_BLOCK;
+			next = 0;
+			priced = 0;
+			if ( chain->kernel == KERNEL_AUTO ) {
+				chain->kernel = timeKernels( chain );
+			}
+		}
+		if ( next == priced ) {
+			priced = next + batch < drawn ? next + batch : drawn;
+			priceMoves( chain, chain->kernel, next, priced );
+			if ( batch < MOVE_BLOCK ) {
+				batch *= 2; /* nothing has been accepted since the last lot, so it is cold enough to price more at once */
+			}
+		}
+		/* The moves whose pair did not give the preference picked (which are not counted as successes) or whose project is taken are rejected as they are, so go straight through those to the next one that needs looking at, counting them as they go */
+		end = priced < next + budget - moves ? priced : next + budget - moves;
+		for ( i = next; i < end && block->verdict[i] != BLOCK_OPEN; i++ ) {
+			outright[block->verdict[i]]++;
+		}
+		moves += i - next;
+		next = i;
+		if ( i < end ) {
+			next++;
+			moves++;
+			trialEnergy = *currentEnergy + block->change[i];
+			pair = block->pair[i];
+			if ( temp > 0 && block->change[i] > 0 && randUniform( &chain->rng ) > exp( -block->change[i] / temp ) ) { /* a move that lowers the energy is always accepted, so needs no random number */
+				uphill++;
+			} else if ( temp == 0 && trialEnergy > *currentEnergy ) {
+				uphill++;
+			} else if ( supervisorsOver( chain, chain->projNum[pair], block->proj[i] ) ) {
+				lecturer++;
+			} else { /* accepted. The rest of the block was priced against the allocation before it, so has to be priced again */
+				movePair( chain, pair, block->proj[i], block->pref[i] );
+				*currentEnergy = trialEnergy;
+				successfulmoves++;
+				priced = next;
+				batch = PRICE_FIRST;
+			}
+		}
+
+		if ( driftCheck > 0 && moves / driftCheck > checked ) { /* optional check that the running energy has not drifted from the true one through rounding. Rejections change nothing, so once is enough however many checks they went past */
+			checked = moves / driftCheck;
+			fullEnergy = energy( solver, chain->projPref );
+			if ( fabs( fullEnergy - *currentEnergy ) > 1e-3 ) {
+				report( solver, "Running energy %f has drifted from full energy %f\n", *currentEnergy, fullEnergy);
+			}
+			*currentEnergy = fullEnergy;
+		}
+	}
+	stats.moves = moves;
+	stats.accepted = successfulmoves;
+	stats.clash = outright[BLOCK_CLASH];
+	stats.uphill = uphill;
+	stats.lecturer = lecturer;
+	stats.same = outright[BLOCK_SAME];
+	chain->moves += moves;
+	return stats;
+}
+
+void priceMoves( struct chain *chain, int kernel, int from, int to ) {
+	switch ( kernel ) {
+#ifdef HAVE_X86
+		case KERNEL_AVX2:
+			priceMovesAVX2( chain, from, to );
+			break;
+		case KERNEL_SSE:
+			priceMovesSSE( chain, from, to );
+			break;
+#endif
+		default:
+			priceMovesScalar( chain, from, to );
+	}
+}
+
+/* Prices the block with every kernel the CPU can run, several times over, keeping the quickest time for each. Pricing changes nothing, so this makes no difference to the run, only to how long it takes.
+   The solver's own chain says what it found. RETURNS the quickest kernel */
+int timeKernels( struct chain *chain ) {
+	struct timespec start, end;
+	double quickest[KERNEL_AUTO], took;
+	int kernel, round, best = KERNEL_SCALAR;
+	for ( kernel = KERNEL_SCALAR; kernel < KERNEL_AUTO; kernel++ ) {
+		quickest[kernel] = HUGE_VAL;
+	}
+	for ( round = 0; round < 10; round++ ) {
+		for ( kernel = KERNEL_SCALAR; kernel < KERNEL_AUTO; kernel++ ) {
+			if ( checkKernel( kernel ) < 0 ) {
+				continue;
+			}
+			clock_gettime( CLOCK_MONOTONIC, &start );
+			priceMoves( chain, kernel, 0, MOVE_BLOCK );
+			clock_gettime( CLOCK_MONOTONIC, &end );
+			took = ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec );
+			if ( took < quickest[kernel] ) {
+				quickest[kernel] = took;
+			}
+		}
+	}
+	for ( kernel = KERNEL_SCALAR; kernel < KERNEL_AUTO; kernel++ ) {
+		if ( quickest[kernel] < quickest[best] ) {
+			best = kernel;
+		}
+	}
+	if ( chain == &chain->solver->chain ) {
+		report( chain->solver, "Timed pricing a move:" );
+		for ( kernel = KERNEL_SCALAR; kernel < KERNEL_AUTO; kernel++ ) {
+			if ( quickest[kernel] < HUGE_VAL ) {
+				report( chain->solver, "%s %s %.1f ns", kernel == KERNEL_SCALAR ? "" : ",", kernelNames[kernel], quickest[kernel] / MOVE_BLOCK );
+			}
+		}
+		report( chain->solver, ", so using %s\n\n", kernelNames[best] );
+	}
+	return best;
+}
+
+/* Picks count pairs, and one of the other NUMPREFS-1 preferences for each, as changeAllocationByPref does. Which preference that is depends on the one the pair has when it is priced, so only the pick (0 to NUMPREFS-2) is kept here.
+   Both come from one number, pair*(NUMPREFS-1) + pick, so the division that splits it is by a constant. */
+void drawMoves( struct chain *chain, int count ) {
+	struct moveBlock *block = &chain->block;
+	int i, move;
+	randInts( &chain->rng, chain->problem->cols * ( NUMPREFS - 1 ), count, block->pair );
+	for ( i = 0; i < count; i++ ) {
+		move = block->pair[i];
+		block->pair[i] = move / ( NUMPREFS - 1 );
+		block->skip[i] = move % ( NUMPREFS - 1 );
+	}
+}
+
+/* Prices moves from to to-1 against the allocation as it is. Each kernel does the same, and the vector ones finish off what is left over after the last full vector with this. For each move:
+   pref - the pick, skipping over the preference the pair has (so pick+1, or pick+2 if that is at or past it)
+   proj - the project of that preference, or -1 if the pair did not give it
+   change - the energy after less the energy before, prefEnergy(pref) - prefEnergy(old), which is weight[old] - weight[pref]
+   verdict - BLOCK_SAME if there is no such project, BLOCK_CLASH if it is taken, or else BLOCK_OPEN */
+void priceMovesScalar( struct chain *chain, int from, int to ) {
+	struct moveBlock *block = &chain->block;
+	int *prefProj = &chain->problem->choices.prefProj[0][0];
+	int *projPref = chain->projPref;
+	int *projOcc = chain->ledger.projOcc;
+	float *weight = chain->solver->weight;
+	int i, old, pref, proj;
+	for ( i = from; i < to; i++ ) {
+		old = projPref[block->pair[i]];
+		pref = block->skip[i] + 1;
+		pref += ( pref >= old );
+		proj = prefProj[block->pair[i] * NUMPREFS + pref - 1];
+		block->pref[i] = pref;
+		block->proj[i] = proj;
+		block->change[i] = weight[old] - weight[pref];
+		if ( proj < 0 ) {
+			block->verdict[i] = BLOCK_SAME;
+		} else {
+			block->verdict[i] = projOcc[proj] > 0 ? BLOCK_CLASH : BLOCK_OPEN;
+		}
+	}
+}
+
+#ifdef HAVE_X86
+/* SSE has no gathers, so the lookups are done one lane at a time and only the sums and compares are done 4 at once. The lanes are put together in registers rather than through
+   small arrays, as loading a vector straight after writing its parts one at a time stalls. The verdict is worked out without branching: BLOCK_OPEN (2) plus the compare (-1 if
+   taken), masked to 0 if the pair did not give the preference. */
+void priceMovesSSE( struct chain *chain, int from, int to ) {
+	struct moveBlock *block = &chain->block;
+	int *prefProj = &chain->problem->choices.prefProj[0][0];
+	int *projPref = chain->projPref;
+	int *projOcc = chain->ledger.projOcc;
+	float *weight = chain->solver->weight;
+	__m128i one = _mm_set1_epi32( 1 ), open = _mm_set1_epi32( BLOCK_OPEN ), none = _mm_set1_epi32( -1 ), zero = _mm_setzero_si128();
+	__m128i old, pref, proj, occ, given;
+	int *pair, *o, *p, *q;
+	int lanes[4];
+	int i;
+	for ( i = from; i + 4 <= to; i += 4 ) {
+		pair = block->pair + i;
+		o = lanes;
+		old = _mm_set_epi32( projPref[pair[3]], projPref[pair[2]], projPref[pair[1]], projPref[pair[0]] );
+		pref = _mm_add_epi32( _mm_loadu_si128( (__m128i *) ( block->skip + i ) ), one );
+		pref = _mm_add_epi32( _mm_add_epi32( pref, one ), _mm_cmpgt_epi32( old, pref ) ); /* +1, less 1 where the pick is below old */
+		_mm_storeu_si128( (__m128i *) ( block->pref + i ), pref );
+		_mm_storeu_si128( (__m128i *) o, old );
+		p = block->pref + i;
+		proj = _mm_set_epi32( prefProj[pair[3] * NUMPREFS + p[3] - 1], prefProj[pair[2] * NUMPREFS + p[2] - 1], prefProj[pair[1] * NUMPREFS + p[1] - 1], prefProj[pair[0] * NUMPREFS + p[0] - 1] );
+		_mm_storeu_si128( (__m128i *) ( block->proj + i ), proj );
+		q = block->proj + i;
+		occ = _mm_set_epi32( projOcc[q[3] & ~( q[3] >> 31 )], projOcc[q[2] & ~( q[2] >> 31 )], projOcc[q[1] & ~( q[1] >> 31 )], projOcc[q[0] & ~( q[0] >> 31 )] ); /* project 0 in place of -1, masked off below */
+		_mm_storeu_ps( block->change + i, _mm_sub_ps( _mm_set_ps( weight[o[3]], weight[o[2]], weight[o[1]], weight[o[0]] ), _mm_set_ps( weight[p[3]], weight[p[2]], weight[p[1]], weight[p[0]] ) ) );
+		given = _mm_cmpgt_epi32( proj, none );
+		_mm_storeu_si128( (__m128i *) ( block->verdict + i ), _mm_and_si128( given, _mm_add_epi32( open, _mm_cmpgt_epi32( occ, zero ) ) ) );
+	}
+	priceMovesScalar( chain, i, to );
+}
+
+/* The same as priceMovesSSE, 8 at a time, with AVX2's gathers doing the lookups. The occupancies are only gathered where the pair gave the preference, as -1 is no project. */
+__attribute__(( target( "avx2" ) ))
+void priceMovesAVX2( struct chain *chain, int from, int to ) {
+	struct moveBlock *block = &chain->block;
+	int *prefProj = &chain->problem->choices.prefProj[0][0];
+	int *projPref = chain->projPref;
+	int *projOcc = chain->ledger.projOcc;
+	float *weight = chain->solver->weight;
+	__m256i one = _mm256_set1_epi32( 1 ), prefs = _mm256_set1_epi32( NUMPREFS ), open = _mm256_set1_epi32( BLOCK_OPEN ), none = _mm256_set1_epi32( -1 ), zero = _mm256_setzero_si256();
+	__m256i pair, old, pref, proj, occ, given;
+	__m256 change;
+	int i;
+	for ( i = from; i + 8 <= to; i += 8 ) {
+		pair = _mm256_loadu_si256( (__m256i *) ( block->pair + i ) );
+		old = _mm256_i32gather_epi32( projPref, pair, 4 );
+		pref = _mm256_add_epi32( _mm256_loadu_si256( (__m256i *) ( block->skip + i ) ), one );
+		pref = _mm256_add_epi32( _mm256_add_epi32( pref, one ), _mm256_cmpgt_epi32( old, pref ) ); /* +1, less 1 where the pick is below old */
+		proj = _mm256_i32gather_epi32( prefProj, _mm256_sub_epi32( _mm256_add_epi32( _mm256_mullo_epi32( pair, prefs ), pref ), one ), 4 ); /* pair*NUMPREFS + pref-1 */
+		change = _mm256_sub_ps( _mm256_i32gather_ps( weight, old, 4 ), _mm256_i32gather_ps( weight, pref, 4 ) );
+		given = _mm256_cmpgt_epi32( proj, none );
+		occ = _mm256_mask_i32gather_epi32( zero, projOcc, _mm256_and_si256( proj, given ), given, 4 );
+		_mm256_storeu_si256( (__m256i *) ( block->pref + i ), pref );
+		_mm256_storeu_si256( (__m256i *) ( block->proj + i ), proj );
+		_mm256_storeu_ps( block->change + i, change );
+		_mm256_storeu_si256( (__m256i *) ( block->verdict + i ), _mm256_and_si256( given, _mm256_add_epi32( open, _mm256_cmpgt_epi32( occ, zero ) ) ) );
+	}
+	_mm256_zeroupper(); /* gcc leaves this out before the jump to priceMovesScalar, and the SSE code everywhere else then runs several times slower */
+	priceMovesScalar( chain, i, to );
+}
+#endif
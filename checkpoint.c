@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  Checkpoints, so a long run that gets killed can carry on where it left off.                             */
+/*    Between two temperatures, everything anneal needs to carry on is the allocation and the best one it   */
+/*    has seen, the running energy, where it is in the schedule (struct annealState) and the random         */
+/*    numbers: the generator's working arrays and whatever is left of the buffer it last filled. The        */
+/*    ledger and the rate tree are worked out again from the allocation. With all of that put back, the     */
+/*    run goes exactly as it would have.                                                                    */
+/*    The file is written under another name and then renamed over the old one, so a run killed while      */
+/*    writing it still leaves the previous checkpoint whole.                                                */
+/*    It is a straight copy of memory, so is only meant to be read back by the same build of spa.out.       */
+/************************************************************************************************************/
+
+#define CHECKPOINT_MAGIC "SPACKPT3" /* first 8 bytes of every checkpoint. 2 added which generator the random numbers are from, 3 the best allocation */
+
+/* Saves the chain and state, and seed and the time taken so far to go with them. RETURNS 0, or -1 if it could not be written, in which case the old checkpoint is left alone */
+int writeCheckpoint( char *fileName, struct chain *chain, struct annealState *state, long int seed ) {
+	char tempName[FILENAME_MAX];
+	FILE *file;
+	struct randStream *rng = &chain->rng;
+	double elapsed = wallTime( chain->solver );
+	int cols = chain->problem->cols;
+	int size[3] = { chain->problem->rows, cols, chain->problem->numLec };
+	int ok;
+
+	snprintf( tempName, sizeof(tempName), "%s.tmp", fileName );
+	file = fopen( tempName, "wb" );
+	if ( file == NULL ) {
+		return -1;
+	}
+	ok = fwrite( CHECKPOINT_MAGIC, 1, 8, file ) == 8
+		&& fwrite( size, sizeof(int), 3, file ) == 3
+		&& fwrite( &seed, sizeof(seed), 1, file ) == 1
+		&& fwrite( &elapsed, sizeof(elapsed), 1, file ) == 1
+		&& fwrite( state, sizeof(*state), 1, file ) == 1
+		&& fwrite( &chain->currentEnergy, sizeof(chain->currentEnergy), 1, file ) == 1
+		&& fwrite( &chain->moves, sizeof(chain->moves), 1, file ) == 1
+		&& fwrite( &chain->targetTime, sizeof(chain->targetTime), 1, file ) == 1
+		&& fwrite( chain->projNum, sizeof(int), cols, file ) == (size_t) cols
+		&& fwrite( chain->projPref, sizeof(int), cols, file ) == (size_t) cols
+		&& fwrite( chain->bestNum, sizeof(int), cols, file ) == (size_t) cols
+		&& fwrite( chain->bestPref, sizeof(int), cols, file ) == (size_t) cols
+		&& fwrite( &rng->generator, sizeof(rng->generator), 1, file ) == 1
+		&& ( rng->generator == RNG_PHILOX ? fwrite( &rng->philox, sizeof(rng->philox), 1, file ) == 1 : write_random_generator_r( &rng->gen, file ) == 0 )
+		&& fwrite( &rng->cursor, sizeof(rng->cursor), 1, file ) == 1
+		&& fwrite( rng->buffer + rng->cursor, sizeof(int), RAND_BUFFER - rng->cursor, file ) == (size_t) ( RAND_BUFFER - rng->cursor ); /* only what is left to use */
+	ok = ok && fflush( file ) == 0 && fsync( fileno( file ) ) == 0; /* on the disk before it replaces the old one */
+	if ( fclose( file ) != 0 || !ok || rename( tempName, fileName ) != 0 ) {
+		remove( tempName );
+		return -1;
+	}
+	return 0;
+}
+
+/* Puts back what writeCheckpoint saved. The chain must already have been made by allocChain for the same files. elapsed is the time the run had taken.
+   RETURNS 0, or -1 with the reason in error */
+int readCheckpoint( char *fileName, struct chain *chain, struct annealState *state, long int *seed, double *elapsed, char error[ERROR_LENGTH] ) {
+	FILE *file;
+	struct randStream *rng = &chain->rng;
+	int rows = chain->problem->rows, cols = chain->problem->cols;
+	char magic[8];
+	int size[3];
+	int generator = -1; /* the one the checkpoint's random numbers are from */
+	int ok, i;
+
+	file = fopen( fileName, "rb" );
+	if ( file == NULL ) {
+		snprintf( error, ERROR_LENGTH, "Could not open checkpoint %s", fileName );
+		return -1;
+	}
+	if ( fread( magic, 1, 8, file ) != 8 || memcmp( magic, CHECKPOINT_MAGIC, 8 ) != 0 ) {
+		snprintf( error, ERROR_LENGTH, "%s is not a checkpoint", fileName );
+		fclose( file );
+		return -1;
+	}
+	if ( fread( size, sizeof(int), 3, file ) != 3 || size[0] != rows || size[1] != cols || size[2] != chain->problem->numLec ) {
+		snprintf( error, ERROR_LENGTH, "%s is from a problem of a different size, not these files", fileName );
+		fclose( file );
+		return -1;
+	}
+	ok = fread( seed, sizeof(*seed), 1, file ) == 1
+		&& fread( elapsed, sizeof(*elapsed), 1, file ) == 1
+		&& fread( state, sizeof(*state), 1, file ) == 1
+		&& fread( &chain->currentEnergy, sizeof(chain->currentEnergy), 1, file ) == 1
+		&& fread( &chain->moves, sizeof(chain->moves), 1, file ) == 1
+		&& fread( &chain->targetTime, sizeof(chain->targetTime), 1, file ) == 1
+		&& fread( chain->projNum, sizeof(int), cols, file ) == (size_t) cols
+		&& fread( chain->projPref, sizeof(int), cols, file ) == (size_t) cols
+		&& fread( chain->bestNum, sizeof(int), cols, file ) == (size_t) cols
+		&& fread( chain->bestPref, sizeof(int), cols, file ) == (size_t) cols
+		&& fread( &generator, sizeof(generator), 1, file ) == 1
+		&& generator == rng->generator
+		&& ( rng->generator == RNG_PHILOX ? fread( &rng->philox, sizeof(rng->philox), 1, file ) == 1 : read_random_generator_r( &rng->gen, file ) == 0 )
+		&& fread( &rng->cursor, sizeof(rng->cursor), 1, file ) == 1
+		&& rng->cursor >= 0 && rng->cursor <= RAND_BUFFER
+		&& fread( rng->buffer + rng->cursor, sizeof(int), RAND_BUFFER - rng->cursor, file ) == (size_t) ( RAND_BUFFER - rng->cursor );
+	fclose( file );
+	for ( i = 0; ok && i < cols; i++ ) {
+		ok = chain->projNum[i] >= 0 && chain->projNum[i] < rows && chain->projPref[i] >= 1 && chain->projPref[i] <= NUMPREFS
+			&& chain->bestNum[i] >= 0 && chain->bestNum[i] < rows && chain->bestPref[i] >= 1 && chain->bestPref[i] <= NUMPREFS;
+	}
+	if ( generator >= 0 && generator < RNG_KINDS && generator != rng->generator ) {
+		snprintf( error, ERROR_LENGTH, "Checkpoint %s was made with --rng %s", fileName, rngNames[generator] );
+		return -1;
+	}
+	if ( !ok ) {
+		snprintf( error, ERROR_LENGTH, "Checkpoint %s is cut short or damaged", fileName );
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include "libspa.h"
+
+/************************************************************************************************************/
+/*                       Instance compiler                                                                  */
+/*  Reads a choices file and a supervisors file once and saves the problem as a compiled instance, which    */
+/*  spa.out (and --batch and --serve) can then map straight into memory instead of reading the csv files    */
+/*  again. See instance.c for what is in one.                                                               */
+/*                                                                                                          */
+/*    Run as  ./compile.out choices.csv supervisors.csv instance.spab                                       */
+/*    or as   ./compile.out instance.spab  to check an instance and print its size.                         */
+/*                                                                                                          */
+/*  A compiled instance is only for the machine type and version of spa.out that made it: compile it        */
+/*  again after changing either, or the csv files.                                                          */
+/************************************************************************************************************/
+
+int main( int argc, char *argv[] ) {
+	struct problem *problem;
+	char error[ERROR_LENGTH];
+	int projects, pairs, supervisors;
+
+	if ( argc == 4 ) {
+		problem = spaLoadProblem( argv[1], argv[2], error );
+		if ( problem == NULL || spaCompileProblem( problem, argv[3], error ) != 0 ) {
+			fprintf(stderr, "%s\n", error);
+			return 1;
+		}
+	} else if ( argc == 2 ) {
+		problem = spaLoadCompiled( argv[1], error );
+		if ( problem == NULL ) {
+			fprintf(stderr, "%s\n", error);
+			return 1;
+		}
+	} else {
+		fprintf(stderr, "Usage: %s choices.csv supervisors.csv instance.spab\n       %s instance.spab\n", argv[0], argv[0]);
+		return 1;
+	}
+	spaProblemSize( problem, &projects, &pairs, &supervisors );
+	printf("%s: %d projects, %d pairs, %d supervisors\n", argv[argc-1], projects, pairs, supervisors);
+	spaFreeProblem( problem );
+	return 0;
+}
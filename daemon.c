@@ -0,0 +1,718 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "libspa.h"
+
+/************************************************************************************************************/
+/*  Daemon mode: a long running solver on a Unix domain socket, so a planning tool firing off many what-if  */
+/*  solves does not pay for starting up and reading the files every time.                                   */
+/*    Instances are read in once with load and kept in memory until unloaded. Solves are queued and run on  */
+/*    a pool of numWorkers threads, each with a solver of its own on the shared instance, and the result    */
+/*    of each is sent back to whoever asked for it as soon as it is done, tagged with the request number    */
+/*    it was given, so a client can have many solves going at once. Nothing is written to finalConfig.txt.  */
+/*    The protocol is lines of text, words separated by spaces:                                             */
+/*        load ID choices.csv supervisors.csv   ->  ok ID projects pairs supervisors                        */
+/*        load ID instance.spab                 ->  the same, for a compiled instance (see instance.c)      */
+/*        unload ID                             ->  ok ID                                                   */
+/*        list                                  ->  instance ID projects pairs supervisors ... then ok      */
+/*        solve ID [seed=S] [scores=A,B,C,D] [time=T]                                                       */
+/*                                              ->  queued N, and later                                     */
+/*                                                  result N energy bound moves seconds                     */
+/*                                                  allocation N project,preference ... (one per pair)      */
+/*                                                  or failed N why                                         */
+/*        shutdown                              ->  ok, once the queued solves are done                     */
+/*    Until then the other clients are still answered, but no more solves are taken.                        */
+/*    Anything that cannot be done gets error and why. Every solve starts from the options spa.out was      */
+/*    given, with the seed (by default the run's seed plus the request number), scores and time limit in    */
+/*    seconds changed as asked. The main thread does all the reading of requests and loading, so the        */
+/*    workers only ever solve.                                                                              */
+/*    Nothing waits on a client: the sockets are non-blocking, and what is sent to each goes on a queue of  */
+/*    its own that the main thread sends on as the client reads it. A client that lets more than            */
+/*    MAX_PENDING bytes pile up unread is dropped, rather than it holding up the workers or filling memory.  */
+/************************************************************************************************************/
+
+#define MAX_CLIENTS 64 /* connections at once */
+#define REQUEST_LINE 4096 /* longest request */
+#define MAX_WORDS 8 /* most words in a request */
+#define MAX_PENDING ( 64 << 20 ) /* most bytes waiting to be sent to a client that is not reading them */
+#define FIRST_CLIENT 2 /* fds[0] is the listening socket and fds[1] the wake pipe */
+#define SHUTDOWN_GRACE 5000 /* ms to wait, once shut down, for clients to read what is still queued for them */
+
+/* An instance read in by load. Only freed once unloaded and no solve is using it. */
+struct instance {
+	char *id;
+	struct problem *problem; /* read only */
+	int users; /* solves queued or running on it */
+	int unloaded; /* 1 once unloaded, so it can no longer be found */
+};
+
+/* One connection. The main thread reads from it, and the workers write results to it. Freed once closed and no solve is left to answer. */
+struct client {
+	int fd; /* non-blocking */
+	int refs; /* 1 while the main thread has it open, plus one for every solve it is waiting on */
+	int wake; /* the daemon's wake pipe, for when something is left on out */
+	pthread_mutex_t writeLock; /* guards out and broken, and keeps lines from different workers from getting mixed up */
+	char *out; /* what has been sent to it that the socket has not taken yet, from outStart to outEnd */
+	size_t outStart, outEnd, outSize;
+	int broken; /* 1 once it has gone or let too much pile up. Nothing more is sent */
+	int hungUp; /* 1 once the main thread has read all it will, so it is only kept for the answers still to come */
+	char line[REQUEST_LINE]; /* what has been read of the next request */
+	int used;
+};
+
+/* One solve waiting for a worker. */
+struct request {
+	long int number;
+	struct instance *instance;
+	struct client *client;
+	struct settings settings;
+	struct request *next;
+};
+
+/* Everything the threads share. */
+struct daemon {
+	struct settings *settings; /* what every solve starts from */
+	struct instance **instances;
+	int numInstances, capacity;
+	struct request *head, *tail; /* the queue */
+	long int requests; /* solves asked for so far */
+	int stopping; /* 1 once shutdown has been asked for. Only the main thread sets it */
+	int workers; /* threads of the pool still running */
+	struct client *stopper; /* who asked for shutdown, answered once the workers have finished */
+	int wake[2]; /* a pipe a worker writes to when it leaves something on a client's queue, so the main thread stops waiting and sends it */
+	pthread_mutex_t lock; /* guards the queue, users and refs */
+	pthread_cond_t ready; /* signalled when something is queued, or it is stopping */
+};
+
+int openSocket( char *socketPath ); /* RETURNS the listening socket, or -1 */
+void *runWorker( void *arg ); /* the work of one thread */
+void solveRequest( struct request *request ); /* solves one request and sends back the result */
+void handleLine( struct daemon *daemon, struct client *client, char *line ); /* carries out one request */
+int readClient( struct daemon *daemon, struct client *client ); /* reads what the client has sent. RETURNS 0, or -1 once it has gone */
+struct instance *findInstance( struct daemon *daemon, char *id );
+void releaseInstance( struct daemon *daemon, struct instance *instance ); /* one fewer solve on it */
+void releaseClient( struct daemon *daemon, struct client *client ); /* one fewer reference to it */
+void sendLine( struct client *client, const char *format, ... ); /* writes one line to the client. Lost if it has gone */
+void sendText( struct client *client, char *text, size_t length ); /* puts text on the client's queue and sends what it can of it now */
+void flushClient( struct client *client ); /* sends what the socket will take. The write lock must be held */
+void breakClient( struct client *client ); /* gives up on the client. The write lock must be held */
+int pendingClient( struct client *client ); /* RETURNS 1 if there is something waiting to be sent */
+void wakeDaemon( int wake ); /* stops the main thread waiting in poll, so it looks at every client again */
+
+int runDaemon( char *socketPath, int numWorkers, struct settings *settings ) {
+	struct daemon daemon;
+	struct pollfd fds[MAX_CLIENTS + FIRST_CLIENT];
+	struct client *clients[MAX_CLIENTS + FIRST_CLIENT];
+	struct client *client;
+	pthread_t *pool;
+	pthread_mutexattr_t recursive;
+	char drain[64];
+	int listener, numFds = FIRST_CLIENT, finished, unsent, pending, waiting, ready, i, fd;
+
+	listener = openSocket( socketPath );
+	if ( listener < 0 ) {
+		return 1;
+	}
+	if ( pipe( daemon.wake ) != 0 ) {
+		perror( "pipe" );
+		close( listener );
+		return 1;
+	}
+	fcntl( daemon.wake[0], F_SETFL, O_NONBLOCK );
+	fcntl( daemon.wake[1], F_SETFL, O_NONBLOCK ); /* a full pipe already means the main thread will wake */
+	signal( SIGPIPE, SIG_IGN ); /* a client going away while being written to is not the end of the daemon */
+	if ( numWorkers == 0 ) {
+		numWorkers = (int) sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	if ( numWorkers < 1 ) {
+		numWorkers = 1;
+	}
+	settings->chainSummary = NULL; /* the solves would all write over the one file */
+	daemon.settings = settings;
+	daemon.instances = NULL;
+	daemon.numInstances = 0;
+	daemon.capacity = 0;
+	daemon.head = NULL;
+	daemon.tail = NULL;
+	daemon.requests = 0;
+	daemon.stopping = 0;
+	daemon.workers = numWorkers;
+	daemon.stopper = NULL;
+	pthread_mutex_init( &daemon.lock, NULL );
+	pthread_cond_init( &daemon.ready, NULL );
+	pthread_mutexattr_init( &recursive );
+	pthread_mutexattr_settype( &recursive, PTHREAD_MUTEX_RECURSIVE ); /* see sendText */
+	pool = malloc( numWorkers * sizeof(pthread_t) );
+	if ( pool == NULL ) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for ( i = 0; i < numWorkers; i++ ) {
+		if ( pthread_create( &pool[i], NULL, runWorker, &daemon ) != 0 ) {
+			fprintf(stderr, "Could not start thread %d\n", i);
+			exit(1);
+		}
+	}
+	printf("Listening on %s with %d workers\n", socketPath, numWorkers);
+	fflush( stdout );
+
+	fds[0].fd = listener;
+	fds[0].events = POLLIN;
+	fds[1].fd = daemon.wake[0];
+	fds[1].events = POLLIN;
+	for ( ;; ) {
+		pthread_mutex_lock( &daemon.lock );
+		finished = daemon.stopping && daemon.workers == 0;
+		pthread_mutex_unlock( &daemon.lock );
+		if ( finished && daemon.stopper != NULL ) { /* every queued solve has been answered */
+			sendLine( daemon.stopper, "ok\n" );
+			releaseClient( &daemon, daemon.stopper );
+			daemon.stopper = NULL;
+		}
+		unsent = 0;
+		/* what to wait for on each client. One that has hung up is only kept while it has answers to come, and is not polled unless one is waiting to be sent */
+		for ( i = numFds - 1; i >= FIRST_CLIENT; i-- ) { /* backwards, so a closed one can be swapped with the last */
+			client = clients[i];
+			pending = pendingClient( client );
+			pthread_mutex_lock( &daemon.lock );
+			waiting = client->refs > 1;
+			pthread_mutex_unlock( &daemon.lock );
+			if ( client->hungUp && !pending && ( !waiting || client->broken ) ) {
+				releaseClient( &daemon, client );
+				numFds--;
+				fds[i] = fds[numFds];
+				clients[i] = clients[numFds];
+				continue;
+			}
+			fds[i].fd = client->hungUp && !pending ? -1 : client->fd;
+			fds[i].events = ( client->hungUp ? 0 : POLLIN ) | ( pending ? POLLOUT : 0 );
+			unsent |= pending;
+		}
+		if ( finished && !unsent ) {
+			break;
+		}
+		ready = poll( fds, numFds, finished ? SHUTDOWN_GRACE : -1 );
+		if ( ready < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			perror( "poll" );
+			break;
+		}
+		if ( ready == 0 ) { /* only once finished: nobody has read what is left for them */
+			break;
+		}
+		if ( fds[1].revents & POLLIN ) {
+			while ( read( daemon.wake[0], drain, sizeof(drain) ) > 0 ) {
+			}
+		}
+		for ( i = FIRST_CLIENT; i < numFds; i++ ) {
+			client = clients[i];
+			if ( fds[i].revents & ( POLLOUT | POLLERR ) ) {
+				pthread_mutex_lock( &client->writeLock );
+				flushClient( client );
+				pthread_mutex_unlock( &client->writeLock );
+			}
+			if ( !client->hungUp && ( fds[i].revents & ( POLLIN | POLLHUP | POLLERR ) ) ) {
+				if ( readClient( &daemon, client ) < 0 ) {
+					client->hungUp = 1;
+				}
+			}
+		}
+		if ( fds[0].revents & POLLIN ) {
+			fd = accept( listener, NULL, NULL );
+			if ( fd >= 0 && numFds == MAX_CLIENTS + FIRST_CLIENT ) {
+				close( fd ); /* full. It can try again later */
+			} else if ( fd >= 0 ) {
+				client = malloc( sizeof(struct client) );
+				if ( client == NULL ) {
+					fprintf(stderr, "Out of memory\n");
+					exit(1);
+				}
+				fcntl( fd, F_SETFL, O_NONBLOCK );
+				client->fd = fd;
+				client->refs = 1;
+				client->wake = daemon.wake[1];
+				client->out = NULL;
+				client->outStart = 0;
+				client->outEnd = 0;
+				client->outSize = 0;
+				client->broken = 0;
+				client->hungUp = 0;
+				client->used = 0;
+				pthread_mutex_init( &client->writeLock, &recursive );
+				fds[numFds].fd = fd;
+				fds[numFds].events = POLLIN;
+				clients[numFds] = client;
+				numFds++;
+			}
+		}
+	}
+
+	/* the workers have finished unless poll failed, in which case they finish what is queued. Then tidy up */
+	pthread_mutex_lock( &daemon.lock );
+	daemon.stopping = 1;
+	pthread_cond_broadcast( &daemon.ready );
+	pthread_mutex_unlock( &daemon.lock );
+	for ( i = 0; i < numWorkers; i++ ) {
+		pthread_join( pool[i], NULL );
+	}
+	if ( daemon.stopper != NULL ) {
+		releaseClient( &daemon, daemon.stopper );
+	}
+	for ( i = FIRST_CLIENT; i < numFds; i++ ) {
+		releaseClient( &daemon, clients[i] );
+	}
+	for ( i = 0; i < daemon.numInstances; i++ ) {
+		spaFreeProblem( daemon.instances[i]->problem );
+		free( daemon.instances[i]->id );
+		free( daemon.instances[i] );
+	}
+	free( daemon.instances );
+	free( pool );
+	pthread_mutexattr_destroy( &recursive );
+	pthread_cond_destroy( &daemon.ready );
+	pthread_mutex_destroy( &daemon.lock );
+	close( daemon.wake[0] );
+	close( daemon.wake[1] );
+	close( listener );
+	unlink( socketPath );
+	printf("Shut down after %ld solves\n", daemon.requests);
+	return 0;
+}
+
+/* Makes the socket and listens on it. A socket file left behind by a daemon that is no longer running is replaced, but not one still in use. */
+int openSocket( char *socketPath ) {
+	struct sockaddr_un address;
+	int fd;
+
+	if ( strlen( socketPath ) >= sizeof(address.sun_path) ) {
+		fprintf(stderr, "The socket path %s is too long\n", socketPath);
+		return -1;
+	}
+	memset( &address, 0, sizeof(address) );
+	address.sun_family = AF_UNIX;
+	strcpy( address.sun_path, socketPath );
+	fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if ( fd < 0 ) {
+		perror( "socket" );
+		return -1;
+	}
+	if ( connect( fd, (struct sockaddr *) &address, sizeof(address) ) == 0 ) {
+		fprintf(stderr, "There is already a daemon listening on %s\n", socketPath);
+		close( fd );
+		return -1;
+	}
+	unlink( socketPath );
+	if ( bind( fd, (struct sockaddr *) &address, sizeof(address) ) != 0 || listen( fd, 16 ) != 0 ) {
+		fprintf(stderr, "Could not listen on %s: %s\n", socketPath, strerror( errno ));
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+/* One thread of the pool. Takes the next request off the queue until there are none left and it is stopping. */
+void *runWorker( void *arg ) {
+	struct daemon *daemon = arg;
+	struct request *request;
+
+	for ( ;; ) {
+		pthread_mutex_lock( &daemon->lock );
+		while ( daemon->head == NULL && !daemon->stopping ) {
+			pthread_cond_wait( &daemon->ready, &daemon->lock );
+		}
+		request = daemon->head;
+		if ( request == NULL ) { /* stopping, and nothing left */
+			daemon->workers--;
+			pthread_mutex_unlock( &daemon->lock );
+			wakeDaemon( daemon->wake[1] ); /* the last one out lets the main thread answer shutdown */
+			return NULL;
+		}
+		daemon->head = request->next;
+		if ( daemon->head == NULL ) {
+			daemon->tail = NULL;
+		}
+		pthread_mutex_unlock( &daemon->lock );
+
+		solveRequest( request );
+		releaseInstance( daemon, request->instance );
+		releaseClient( daemon, request->client );
+		free( request );
+		wakeDaemon( daemon->wake[1] ); /* the client may have hung up and only been waiting for this */
+	}
+}
+
+void solveRequest( struct request *request ) {
+	struct problem *problem = request->instance->problem;
+	struct solver *solver;
+	struct result result;
+	char error[ERROR_LENGTH];
+	int *projNum, *projPref;
+	char *text;
+	size_t length;
+	int i;
+
+	solver = spaNewSolver( problem, &request->settings, NULL, error );
+	if ( solver == NULL || spaSolve( solver, NULL, error ) != 0 ) {
+		sendLine( request->client, "failed %ld %s\n", request->number, error );
+		if ( solver != NULL ) {
+			spaFreeSolver( solver );
+		}
+		return;
+	}
+	spaGetResult( solver, &result );
+	projNum = malloc( result.pairs * sizeof(int) );
+	projPref = malloc( result.pairs * sizeof(int) );
+	text = malloc( 32 + result.pairs * 24 ); /* room for every pair's project and preference */
+	if ( projNum == NULL || projPref == NULL || text == NULL ) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	spaGetAllocation( solver, projNum, projPref );
+	spaFreeSolver( solver );
+
+	length = sprintf( text, "allocation %ld", request->number );
+	for ( i = 0; i < result.pairs; i++ ) {
+		length += sprintf( text + length, " %d,%d", projNum[i] + 1, projPref[i] );
+	}
+	text[length++] = '\n';
+	pthread_mutex_lock( &request->client->writeLock ); /* keep the two lines together */
+	if ( result.bound > -HUGE_VAL ) {
+		sendLine( request->client, "result %ld %f %f %ld %.3f\n", request->number, result.energy, result.bound, result.moves, result.seconds );
+	} else {
+		sendLine( request->client, "result %ld %f none %ld %.3f\n", request->number, result.energy, result.moves, result.seconds );
+	}
+	sendText( request->client, text, length );
+	pthread_mutex_unlock( &request->client->writeLock );
+	free( text );
+	free( projNum );
+	free( projPref );
+}
+
+int readClient( struct daemon *daemon, struct client *client ) {
+	char *start, *end;
+	ssize_t got;
+
+	got = read( client->fd, client->line + client->used, sizeof(client->line) - 1 - client->used );
+	if ( got < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) ) {
+		return 0;
+	}
+	if ( got <= 0 ) {
+		return -1;
+	}
+	client->used += got;
+	client->line[client->used] = '\0';
+	start = client->line;
+	while ( ( end = strchr( start, '\n' ) ) != NULL ) {
+		*end = '\0';
+		handleLine( daemon, client, start );
+		start = end + 1;
+	}
+	client->used -= start - client->line; /* keep whatever is left of the next line */
+	memmove( client->line, start, client->used );
+	if ( client->used == sizeof(client->line) - 1 ) {
+		sendLine( client, "error request longer than %d characters\n", REQUEST_LINE - 1 );
+		return -1;
+	}
+	return 0;
+}
+
+void handleLine( struct daemon *daemon, struct client *client, char *line ) {
+	char *word[MAX_WORDS + 1]; /* one over, to tell if there were too many */
+	char error[ERROR_LENGTH];
+	struct instance *instance;
+	struct request *request;
+	struct settings settings;
+	int numWords = 0, projects, pairs, supervisors, i;
+
+	for ( word[0] = strtok( line, " \t\r" ); word[numWords] != NULL && numWords < MAX_WORDS; word[numWords] = strtok( NULL, " \t\r" ) ) {
+		numWords++;
+	}
+	releaseInstance( daemon, NULL ); /* free anything unloaded whose solves have since finished */
+	if ( numWords == 0 ) {
+		return;
+	}
+	if ( word[numWords] != NULL ) {
+		sendLine( client, "error too many words\n" );
+		return;
+	}
+
+	if ( strcmp( word[0], "load" ) == 0 && ( numWords == 3 || numWords == 4 ) ) {
+		if ( findInstance( daemon, word[1] ) != NULL ) {
+			sendLine( client, "error there is already an instance %s\n", word[1] );
+			return;
+		}
+		instance = malloc( sizeof(struct instance) );
+		if ( instance == NULL ) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		if ( numWords == 3 ) {
+			instance->problem = spaLoadCompiled( word[2], error );
+		} else {
+			instance->problem = spaLoadProblem( word[2], word[3], error );
+		}
+		if ( instance->problem == NULL ) {
+			sendLine( client, "error %s\n", error );
+			free( instance );
+			return;
+		}
+		instance->id = strdup( word[1] );
+		instance->users = 0;
+		instance->unloaded = 0;
+		if ( daemon->numInstances == daemon->capacity ) {
+			daemon->capacity = daemon->capacity ? 2 * daemon->capacity : 16;
+			daemon->instances = realloc( daemon->instances, daemon->capacity * sizeof(struct instance *) );
+			if ( daemon->instances == NULL ) {
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+		}
+		daemon->instances[daemon->numInstances++] = instance;
+		spaProblemSize( instance->problem, &projects, &pairs, &supervisors );
+		sendLine( client, "ok %s %d %d %d\n", instance->id, projects, pairs, supervisors );
+
+	} else if ( strcmp( word[0], "unload" ) == 0 && numWords == 2 ) {
+		instance = findInstance( daemon, word[1] );
+		if ( instance == NULL ) {
+			sendLine( client, "error no instance %s\n", word[1] );
+			return;
+		}
+		pthread_mutex_lock( &daemon->lock );
+		instance->unloaded = 1;
+		pthread_mutex_unlock( &daemon->lock );
+		releaseInstance( daemon, NULL ); /* frees it now if nothing is solving it, or else on a later request */
+		sendLine( client, "ok %s\n", word[1] );
+
+	} else if ( strcmp( word[0], "list" ) == 0 && numWords == 1 ) {
+		pthread_mutex_lock( &client->writeLock );
+		for ( i = 0; i < daemon->numInstances; i++ ) {
+			if ( !daemon->instances[i]->unloaded ) {
+				spaProblemSize( daemon->instances[i]->problem, &projects, &pairs, &supervisors );
+				sendLine( client, "instance %s %d %d %d\n", daemon->instances[i]->id, projects, pairs, supervisors );
+			}
+		}
+		sendLine( client, "ok\n" );
+		pthread_mutex_unlock( &client->writeLock );
+
+	} else if ( strcmp( word[0], "solve" ) == 0 && numWords >= 2 ) {
+		if ( daemon->stopping ) {
+			sendLine( client, "error shutting down\n" );
+			return;
+		}
+		instance = findInstance( daemon, word[1] );
+		if ( instance == NULL ) {
+			sendLine( client, "error no instance %s\n", word[1] );
+			return;
+		}
+		settings = *daemon->settings;
+		settings.seed = 0;
+		for ( i = 2; i < numWords; i++ ) {
+			if ( sscanf( word[i], "seed=%ld", &settings.seed ) == 1 && settings.seed >= 0 ) {
+				continue;
+			}
+			if ( sscanf( word[i], "scores=%f,%f,%f,%f", &settings.score[0], &settings.score[1], &settings.score[2], &settings.score[3] ) == NUMPREFS ) {
+				continue;
+			}
+			if ( sscanf( word[i], "time=%lf", &settings.timeLimit ) == 1 && settings.timeLimit >= 0 ) {
+				continue;
+			}
+			sendLine( client, "error %s is not seed=S, scores=A,B,C,D or time=T\n", word[i] );
+			return;
+		}
+		request = malloc( sizeof(struct request) );
+		if ( request == NULL ) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		request->instance = instance;
+		request->client = client;
+		request->settings = settings;
+		request->next = NULL;
+		pthread_mutex_lock( &client->writeLock ); /* so a worker cannot answer it before it has been said to be queued */
+		pthread_mutex_lock( &daemon->lock );
+		request->number = ++daemon->requests;
+		if ( request->settings.seed == 0 ) {
+			request->settings.seed = daemon->settings->seed + request->number;
+		}
+		instance->users++;
+		client->refs++;
+		if ( daemon->tail == NULL ) {
+			daemon->head = request;
+		} else {
+			daemon->tail->next = request;
+		}
+		daemon->tail = request;
+		pthread_cond_signal( &daemon->ready );
+		pthread_mutex_unlock( &daemon->lock );
+		sendLine( client, "queued %ld\n", request->number );
+		pthread_mutex_unlock( &client->writeLock );
+
+	} else if ( strcmp( word[0], "shutdown" ) == 0 && numWords == 1 ) {
+		if ( daemon->stopping ) {
+			sendLine( client, "error already shutting down\n" );
+			return;
+		}
+		pthread_mutex_lock( &daemon->lock );
+		daemon->stopping = 1; /* the workers finish what is queued, then the main loop answers */
+		client->refs++;
+		pthread_cond_broadcast( &daemon->ready );
+		pthread_mutex_unlock( &daemon->lock );
+		daemon->stopper = client;
+
+	} else {
+		sendLine( client, "error unknown request %s. Try load, unload, list, solve or shutdown\n", word[0] );
+	}
+}
+
+/* Only the main thread adds or removes instances, so this needs no lock. */
+struct instance *findInstance( struct daemon *daemon, char *id ) {
+	int i;
+	for ( i = 0; i < daemon->numInstances; i++ ) {
+		if ( !daemon->instances[i]->unloaded && strcmp( daemon->instances[i]->id, id ) == 0 ) {
+			return daemon->instances[i];
+		}
+	}
+	return NULL;
+}
+
+/* Called by a worker when a solve on instance is done, or by the main thread with NULL after an unload. Instances that are unloaded and unused are freed, but only by the main thread, as it is the one looking through them. */
+void releaseInstance( struct daemon *daemon, struct instance *instance ) {
+	int i;
+	pthread_mutex_lock( &daemon->lock );
+	if ( instance != NULL ) {
+		instance->users--;
+		pthread_mutex_unlock( &daemon->lock );
+		return;
+	}
+	for ( i = 0; i < daemon->numInstances; i++ ) {
+		instance = daemon->instances[i];
+		if ( instance->unloaded && instance->users == 0 ) {
+			spaFreeProblem( instance->problem );
+			free( instance->id );
+			free( instance );
+			daemon->instances[i--] = daemon->instances[--daemon->numInstances];
+		}
+	}
+	pthread_mutex_unlock( &daemon->lock );
+}
+
+void releaseClient( struct daemon *daemon, struct client *client ) {
+	int refs;
+	pthread_mutex_lock( &daemon->lock );
+	refs = --client->refs;
+	pthread_mutex_unlock( &daemon->lock );
+	if ( refs == 0 ) {
+		close( client->fd );
+		pthread_mutex_destroy( &client->writeLock );
+		free( client->out );
+		free( client );
+	}
+}
+
+void sendLine( struct client *client, const char *format, ... ) {
+	char text[REQUEST_LINE + ERROR_LENGTH];
+	va_list args;
+	int length;
+	va_start( args, format );
+	length = vsnprintf( text, sizeof(text), format, args );
+	va_end( args );
+	if ( length >= (int) sizeof(text) ) {
+		length = sizeof(text) - 1;
+		text[length - 1] = '\n';
+	}
+	sendText( client, text, length );
+}
+
+/* Never waits for the client: what the socket will not take now is left on the queue, and the main thread woken to send it once the client has read some.
+   Callers that want several lines kept together hold the write lock around them, and this takes it as well, which is why it is made recursive. */
+void sendText( struct client *client, char *text, size_t length ) {
+	size_t queued;
+	char *grown;
+	pthread_mutex_lock( &client->writeLock );
+	queued = client->outEnd - client->outStart;
+	if ( !client->broken && queued + length > MAX_PENDING ) {
+		breakClient( client ); /* not reading what it is sent */
+	}
+	if ( client->broken ) {
+		pthread_mutex_unlock( &client->writeLock );
+		return;
+	}
+	if ( client->outEnd + length > client->outSize ) { /* move what is left to the front, and make room if that is not enough */
+		memmove( client->out, client->out + client->outStart, queued );
+		client->outStart = 0;
+		client->outEnd = queued;
+		if ( queued + length > client->outSize ) {
+			grown = realloc( client->out, 2 * ( queued + length ) );
+			if ( grown == NULL ) {
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+			client->out = grown;
+			client->outSize = 2 * ( queued + length );
+		}
+	}
+	memcpy( client->out + client->outEnd, text, length );
+	client->outEnd += length;
+	if ( queued == 0 ) { /* otherwise the main thread is already waiting to send what is in front of it */
+		flushClient( client );
+		if ( pendingClient( client ) ) {
+			wakeDaemon( client->wake );
+		}
+	}
+	pthread_mutex_unlock( &client->writeLock );
+}
+
+void flushClient( struct client *client ) {
+	ssize_t sent;
+	while ( !client->broken && client->outStart < client->outEnd ) {
+		sent = send( client->fd, client->out + client->outStart, client->outEnd - client->outStart, MSG_NOSIGNAL );
+		if ( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+			return; /* the socket is full until the client reads some */
+		}
+		if ( sent < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( sent <= 0 ) {
+			breakClient( client ); /* gone */
+			return;
+		}
+		client->outStart += sent;
+	}
+	client->outStart = 0;
+	client->outEnd = 0;
+}
+
+/* Throws away whatever is queued, and shuts the socket so the main thread sees it has gone next time it looks. */
+void breakClient( struct client *client ) {
+	client->broken = 1;
+	client->outStart = 0;
+	client->outEnd = 0;
+	shutdown( client->fd, SHUT_RDWR );
+}
+
+/* If the pipe is full the main thread is going to wake anyway. */
+void wakeDaemon( int wake ) {
+	if ( write( wake, "", 1 ) < 0 ) {
+		return;
+	}
+}
+
+int pendingClient( struct client *client ) {
+	int pending;
+	pthread_mutex_lock( &client->writeLock );
+	pending = client->outStart < client->outEnd;
+	pthread_mutex_unlock( &client->writeLock );
+	return pending;
+}
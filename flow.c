@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  A lower bound on the energy, and a good allocation to start from, by solving the problem exactly with   */
+/*  the lecturer constraint relaxed.                                                                        */
+/*    Without the lecturer constraint, giving every pair a different one of its choices for the least       */
+/*    energy is an assignment problem, and is solved exactly by min-cost flow: pairs are added one at a     */
+/*    time, each by the cheapest path that pushes pairs along from project to project until one lands on   */
+/*    a free project (successive shortest paths, found with Dijkstra using project prices to keep the costs */
+/*    positive). Nothing can do better than this, so its energy is a lower bound.                           */
+/*    The lecturer constraint is brought back by Lagrangian relaxation: each lecturer has a price, and      */
+/*    every project costs the prices of its supervisors times their weightings. Solving the assignment with */
+/*    these costs, less the total of the prices, is still a lower bound. The prices of lecturers with too   */
+/*    much work go up and those with spare go down (subgradient steps), which pushes the bound up towards   */
+/*    the best allocation. Any of the assignments along the way that keeps every lecturer within their      */
+/*    capacity is a real allocation, and the lowest energy one is kept to start the annealing from. If none */
+/*    is, the one with the least work over capacity is kept instead, to be put right by the annealing's     */
+/*    own search for a starting configuration.                                                              */
+/************************************************************************************************************/
+
+/* Working space for the assignment. A slot is a (pair, preference) edge: slot pair*NUMPREFS + k is pair's preference k+1. */
+struct assignment {
+	double *cost; /* cost of each slot, prices included */
+	double *price; /* of each project. Prices only go down from 0, and stay 0 on free projects */
+	double *dist; /* of each project, in the current search */
+	int *reached; /* the search each project was last reached in */
+	int *settled; /* the search each project was last settled in */
+	int *from; /* the slot each project was reached by */
+	int *visited; /* the projects settled in the current search, in order */
+	int *holder; /* the pair on each project, -1 for none */
+	int *slot; /* the slot each pair is on, -1 for none */
+	double *heapKey; /* heap of projects to settle, by distance. A project can be on it more than once, and only the nearest counts */
+	int *heapProj;
+	int heapSize;
+};
+
+int assign( struct assignment *a, struct problem *problem ); /* solves the assignment problem with the costs in a->cost */
+void heapPush( struct assignment *a, double key, int proj );
+int heapPop( struct assignment *a, double *key ); /* RETURNS the nearest project, and its distance in key */
+
+/* Adds up what relaxAllocation takes off the arena, in the same way as chainBytes. */
+size_t flowBytes( struct problem *problem ) {
+	int rows = problem->rows, cols = problem->cols, numLec = problem->numLec;
+	size_t bytes = 0;
+	bytes += 2 * ARENA_ROUND( cols * NUMPREFS * sizeof(double) ); /* cost and heapKey */
+	bytes += ARENA_ROUND( cols * NUMPREFS * sizeof(int) ); /* heapProj */
+	bytes += 2 * ARENA_ROUND( rows * sizeof(double) ); /* price and dist */
+	bytes += 5 * ARENA_ROUND( rows * sizeof(int) ); /* reached, settled, from, visited and holder */
+	bytes += ARENA_ROUND( cols * sizeof(int) ); /* slot */
+	bytes += 3 * ARENA_ROUND( numLec * sizeof(double) ); /* lecturer prices, loads and steps */
+	return bytes;
+}
+
+/* Does up to iterations rounds of pricing (at least one). bound gets the best lower bound found, and projNum and projPref the best allocation.
+   With a time limit, pricing stops once a quarter of it has gone, leaving the rest for the annealing, and it stops too if the run is interrupted.
+   RETURNS 1 if the allocation keeps to every constraint, 0 if it gives every pair a different project but some lecturer has too much work,
+   and -1 if there is no way of giving every pair a different one of its choices at all, when there can be no allocation */
+int relaxAllocation( struct solver *solver, int iterations, struct arena *arena, int projNum[], int projPref[], double *bound ) {
+	struct problem *problem = solver->problem;
+	struct choices *choices = &problem->choices;
+	struct supervisors *sups = &problem->sups;
+	int rows = problem->rows, cols = problem->cols, numLec = problem->numLec;
+	struct assignment a;
+	double *lecPrice, *load, *step;
+	double total, prices, lagrangian, norm, target, theta = 2;
+	double bestFeasible = HUGE_VAL, leastOver = HUGE_VAL, over;
+	float allocEnergy;
+	int found = 0, stuck = 0; /* found is 1 once an allocation keeping to every constraint has been */
+	int it, i, j, k, s, p;
+
+	a.cost = arenaAlloc( arena, cols * NUMPREFS * sizeof(double) );
+	a.heapKey = arenaAlloc( arena, cols * NUMPREFS * sizeof(double) );
+	a.heapProj = arenaAlloc( arena, cols * NUMPREFS * sizeof(int) );
+	a.price = arenaAlloc( arena, rows * sizeof(double) );
+	a.dist = arenaAlloc( arena, rows * sizeof(double) );
+	a.reached = arenaAlloc( arena, rows * sizeof(int) );
+	a.settled = arenaAlloc( arena, rows * sizeof(int) );
+	a.from = arenaAlloc( arena, rows * sizeof(int) );
+	a.visited = arenaAlloc( arena, rows * sizeof(int) );
+	a.holder = arenaAlloc( arena, rows * sizeof(int) );
+	a.slot = arenaAlloc( arena, cols * sizeof(int) );
+	lecPrice = arenaAlloc( arena, numLec * sizeof(double) );
+	load = arenaAlloc( arena, numLec * sizeof(double) );
+	step = arenaAlloc( arena, numLec * sizeof(double) );
+	for ( j = 0; j < numLec; j++ ) {
+		lecPrice[j] = 0;
+	}
+	*bound = -HUGE_VAL;
+
+	for ( it = 0; it < iterations || it == 0; it++ ) {
+		if ( it > 0 && ( solver->interrupted || ( solver->settings.timeLimit > 0 && wallTime( solver ) >= solver->settings.timeLimit / 4 ) ) ) {
+			break;
+		}
+		for ( i = 0; i < cols; i++ ) {
+			for ( k = 0; k < NUMPREFS; k++ ) {
+				p = choices->prefProj[i][k];
+				if ( p < 0 ) {
+					continue;
+				}
+				a.cost[i*NUMPREFS + k] = prefEnergy( solver, k+1 );
+				for ( j = sups->projStart[p]; j < sups->projStart[p+1]; j++ ) {
+					a.cost[i*NUMPREFS + k] += lecPrice[sups->lec[j]] * sups->weight[j];
+				}
+			}
+		}
+		if ( assign( &a, problem ) != 0 ) { /* this does not depend on the prices, so can only happen first time round */
+			return -1;
+		}
+
+		/* the bound, and how much work each lecturer has */
+		total = 0;
+		prices = 0;
+		allocEnergy = 0;
+		for ( j = 0; j < numLec; j++ ) {
+			load[j] = 0;
+			prices += lecPrice[j];
+		}
+		for ( i = 0; i < cols; i++ ) {
+			s = a.slot[i];
+			p = choices->prefProj[i][s % NUMPREFS];
+			total += a.cost[s];
+			allocEnergy += prefEnergy( solver, s % NUMPREFS + 1 );
+			for ( j = sups->projStart[p]; j < sups->projStart[p+1]; j++ ) {
+				load[sups->lec[j]] += sups->weight[j];
+			}
+		}
+		lagrangian = total - prices;
+		if ( lagrangian > *bound + 1e-9 ) {
+			*bound = lagrangian;
+			stuck = 0;
+		} else if ( ++stuck >= 5 ) { /* the steps are overshooting */
+			theta /= 2;
+			stuck = 0;
+		}
+
+		/* keep the allocation if it is the best so far */
+		over = 0;
+		norm = 0;
+		for ( j = 0; j < numLec; j++ ) {
+			step[j] = load[j] - 1; /* the subgradient */
+			if ( step[j] > LOAD_TOLERANCE ) {
+				over += step[j];
+			}
+			if ( lecPrice[j] == 0 && step[j] < 0 ) { /* the price cannot go below 0, so this lecturer does not move */
+				step[j] = 0;
+			}
+			norm += step[j] * step[j];
+		}
+		if ( ( over == 0 && allocEnergy < bestFeasible ) || ( !found && over > 0 && over < leastOver ) ) {
+			for ( i = 0; i < cols; i++ ) {
+				k = a.slot[i] % NUMPREFS;
+				projNum[i] = choices->prefProj[i][k];
+				projPref[i] = k + 1;
+			}
+			if ( over == 0 ) {
+				found = 1;
+				bestFeasible = allocEnergy;
+			} else {
+				leastOver = over;
+			}
+		}
+		if ( ( found && bestFeasible <= *bound + 1e-6 ) || norm == 0 ) { /* the best allocation meets the bound, so is optimal, or the prices have settled */
+			break;
+		}
+
+		/* step the prices towards where the bound would reach the target */
+		target = found ? bestFeasible : lagrangian + 0.05 * fabs( lagrangian ) + 1e-6; /* without an allocation to aim for, guess a little above */
+		for ( j = 0; j < numLec; j++ ) {
+			lecPrice[j] += theta * ( target - lagrangian ) / norm * step[j];
+			if ( lecPrice[j] < 0 ) {
+				lecPrice[j] = 0;
+			}
+		}
+	}
+	return found;
+}
+
+/* Gives every pair a different one of its choices for the least total a->cost. RETURNS 0, or -1 if there is no way of doing so */
+int assign( struct assignment *a, struct problem *problem ) {
+	struct choices *choices = &problem->choices;
+	int rows = problem->rows, cols = problem->cols;
+	int i, j, k, p, q, s, next, found, numVisited;
+	double start, d, reduced, held;
+
+	for ( p = 0; p < rows; p++ ) {
+		a->price[p] = 0;
+		a->reached[p] = -1;
+		a->settled[p] = -1;
+		a->holder[p] = -1;
+	}
+	for ( i = 0; i < cols; i++ ) {
+		a->slot[i] = -1;
+	}
+
+	for ( i = 0; i < cols; i++ ) { /* add pair i */
+		a->heapSize = 0;
+		numVisited = 0;
+		found = -1;
+		start = HUGE_VAL; /* pair i's price: its cheapest project, so every way out of it costs 0 or more */
+		for ( k = 0; k < NUMPREFS; k++ ) {
+			p = choices->prefProj[i][k];
+			if ( p >= 0 && a->cost[i*NUMPREFS + k] - a->price[p] < start ) {
+				start = a->cost[i*NUMPREFS + k] - a->price[p];
+			}
+		}
+		for ( k = 0; k < NUMPREFS; k++ ) {
+			p = choices->prefProj[i][k];
+			if ( p < 0 ) {
+				continue;
+			}
+			d = a->cost[i*NUMPREFS + k] - a->price[p] - start;
+			if ( a->reached[p] != i || d < a->dist[p] ) {
+				a->reached[p] = i;
+				a->dist[p] = d;
+				a->from[p] = i*NUMPREFS + k;
+				heapPush( a, d, p );
+			}
+		}
+		while ( a->heapSize > 0 ) {
+			p = heapPop( a, &d );
+			if ( a->settled[p] == i || d > a->dist[p] ) { /* an old entry */
+				continue;
+			}
+			a->settled[p] = i;
+			a->visited[numVisited++] = p;
+			if ( a->holder[p] < 0 ) { /* a free project - done */
+				found = p;
+				break;
+			}
+			j = a->holder[p]; /* push j off p onto another of its choices */
+			held = a->cost[a->slot[j]] - a->price[p]; /* j's price */
+			for ( k = 0; k < NUMPREFS; k++ ) {
+				q = choices->prefProj[j][k];
+				if ( q < 0 || q == p || a->settled[q] == i ) {
+					continue;
+				}
+				reduced = a->cost[j*NUMPREFS + k] - a->price[q] - held;
+				if ( reduced < 0 ) { /* only rounding */
+					reduced = 0;
+				}
+				if ( a->reached[q] != i || d + reduced < a->dist[q] ) {
+					a->reached[q] = i;
+					a->dist[q] = d + reduced;
+					a->from[q] = j*NUMPREFS + k;
+					heapPush( a, d + reduced, q );
+				}
+			}
+		}
+		if ( found < 0 ) { /* every project i could be pushed to is taken by pairs who cannot move */
+			return -1;
+		}
+
+		/* lower the prices of the projects settled on the way, so the path just found costs 0 and none cost less than 0 */
+		for ( k = 0; k < numVisited; k++ ) {
+			p = a->visited[k];
+			a->price[p] -= a->dist[found] - a->dist[p];
+		}
+		/* and move everyone along the path */
+		p = found;
+		for ( ;; ) {
+			s = a->from[p];
+			j = s / NUMPREFS;
+			next = ( j == i ) ? -1 : choices->prefProj[j][a->slot[j] % NUMPREFS];
+			a->holder[p] = j;
+			a->slot[j] = s;
+			if ( next < 0 ) {
+				break;
+			}
+			p = next;
+		}
+	}
+	return 0;
+}
+
+void heapPush( struct assignment *a, double key, int proj ) {
+	int i = a->heapSize++;
+	while ( i > 0 && a->heapKey[( i - 1 ) / 2] > key ) {
+		a->heapKey[i] = a->heapKey[( i - 1 ) / 2];
+		a->heapProj[i] = a->heapProj[( i - 1 ) / 2];
+		i = ( i - 1 ) / 2;
+	}
+	a->heapKey[i] = key;
+	a->heapProj[i] = proj;
+}
+
+int heapPop( struct assignment *a, double *key ) {
+	int top = a->heapProj[0];
+	double lastKey = a->heapKey[--a->heapSize];
+	int lastProj = a->heapProj[a->heapSize];
+	int i = 0, child;
+	*key = a->heapKey[0];
+	while ( ( child = 2*i + 1 ) < a->heapSize ) {
+		if ( child + 1 < a->heapSize && a->heapKey[child+1] < a->heapKey[child] ) {
+			child++;
+		}
+		if ( a->heapKey[child] >= lastKey ) {
+			break;
+		}
+		a->heapKey[i] = a->heapKey[child];
+		a->heapProj[i] = a->heapProj[child];
+		i = child;
+	}
+	a->heapKey[i] = lastKey;
+	a->heapProj[i] = lastProj;
+	return top;
+}
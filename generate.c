@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*                       Synthetic instance generator                                                       */
+/*  Makes a choices file and a supervisors file in the same form as the examples, of any size, for          */
+/*  testing and benchmarking the annealing. The same options and seed always give the same files.           */
+/*                                                                                                          */
+/*    Run as  ./generate.out [options] pairs projects lecturers prefix                                      */
+/*    which writes prefix_choices.csv and prefix_supervisors.csv.                                           */
+/*                                                                                                          */
+/*  Popularity: some projects are much more popular than others. Project popularity follows Zipf's law,    */
+/*    the one ranked r having weight 1/r^skew, with the ranks shuffled among the projects. skew 0 makes     */
+/*    every project as popular as the rest. Each pair picks 'prefs' different projects, each one picked    */
+/*    in proportion to its weight, and ranks them in the order picked.                                      */
+/*  Workload: the projects are dealt out evenly between the lecturers, and with chance 'cosupervise' a      */
+/*    project has a second supervisor too. Every (project, supervisor) weighting is picked at random from    */
+/*    the list 'weights'.                                                                                    */
+/*  Feasibility: picks made purely by popularity soon leave some pairs fighting over the same few           */
+/*    projects with no allocation breaking no constraints, and the annealing never finds a starting point.  */
+/*    So one allocation is planted: every pair is given a project of its own, put in among its picks at a   */
+/*    random rank, and a second supervisor is only added to one of these if the planted allocation still    */
+/*    keeps the lecturer within their capacity. This needs at least as many projects as pairs, and few      */
+/*    enough pairs per lecturer that a lecturer's share of the planted projects fits in their capacity -    */
+/*    a warning is printed if not.                                                                           */
+/************************************************************************************************************/
+
+#define MAX_WEIGHTS 16 /* the most weightings the list can have */
+#define GEN_BUFFER 10000 /* random numbers made in one go */
+
+int rows, cols, numLec; /* projects, pairs and lecturers, as in Program.c */
+
+long int seed = 1;
+double skew = 0.5; /* Zipf exponent of project popularity */
+int prefs = NUMPREFS; /* how many projects each pair ranks */
+double cosupervise = 0.2; /* chance a project has a second supervisor */
+double weights[MAX_WEIGHTS] = { 0.25, 0.5 }; /* the weightings a supervision can have */
+int numWeights = 2;
+
+struct ranvec_state gen = { NULL, NULL };
+int genBuffer[GEN_BUFFER];
+int genCursor = GEN_BUFFER;
+
+double uniform( void ); /* random number in [0,1) */
+int pick( double *cumulative, int n ); /* random index, with chances from the running totals */
+int readWeights( char *list ); /* fills weights from a comma separated list */
+void usage( char *program );
+
+int main( int argc, char *argv[] ) {
+	double *popularity; /* running totals of the project weights, for pick */
+	int *order; /* shuffled projects */
+	int *pairProj; /* pairProj[pair*prefs + k] is the project pair gives preference k+1 */
+	int *projStart, *chooser, *chooserPref; /* the same turned round: who chose each project, in order of pair */
+	int *sup1, *sup2; /* supervisors of each project. sup2 is -1 if there is only one */
+	float *weight1, *weight2;
+	int *planted; /* planted[j] is the pair given project j in the planted allocation, -1 for none */
+	double *load; /* each lecturer's load in the planted allocation */
+	char *fileName;
+	FILE *file;
+	int i, j, k, p, t, option;
+	struct option options[] = {
+		{ "seed", required_argument, NULL, 's' },
+		{ "skew", required_argument, NULL, 'k' },
+		{ "prefs", required_argument, NULL, 'p' },
+		{ "cosupervise", required_argument, NULL, 'c' },
+		{ "weights", required_argument, NULL, 'w' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ( ( option = getopt_long( argc, argv, "", options, NULL ) ) != -1 ) {
+		switch ( option ) {
+			case 's':
+				seed = atol( optarg );
+				break;
+			case 'k':
+				skew = atof( optarg );
+				break;
+			case 'p':
+				prefs = atoi( optarg );
+				break;
+			case 'c':
+				cosupervise = atof( optarg );
+				break;
+			case 'w':
+				if ( readWeights( optarg ) != 0 ) {
+					fprintf(stderr, "--weights needs 1 to %d weightings above 0 and up to 1, e.g. 0.25,0.5\n", MAX_WEIGHTS);
+					return 1;
+				}
+				break;
+			default:
+				usage( argv[0] );
+				return 1;
+		}
+	}
+	if ( argc - optind != 4 ) {
+		usage( argv[0] );
+		return 1;
+	}
+	cols = atoi( argv[optind] );
+	rows = atoi( argv[optind+1] );
+	numLec = atoi( argv[optind+2] );
+	if ( cols < 1 || numLec < 1 || prefs < 1 || prefs > NUMPREFS || rows < prefs || skew < 0 || cosupervise < 0 || cosupervise > 1 || seed == 0 ) {
+		fprintf(stderr, "Need pairs and lecturers of 1 or more, --prefs from 1 to %d, at least --prefs projects, --skew of 0 or more, --cosupervise from 0 to 1 and a --seed other than 0\n", NUMPREFS);
+		return 1;
+	}
+	if ( numLec < 2 ) {
+		cosupervise = 0;
+	}
+	init_vector_random_generator_r( &gen, seed, GEN_BUFFER );
+
+	popularity = malloc( rows * sizeof(double) );
+	order = malloc( rows * sizeof(int) );
+	pairProj = malloc( cols * prefs * sizeof(int) );
+	projStart = calloc( rows + 1, sizeof(int) );
+	chooser = malloc( cols * prefs * sizeof(int) );
+	chooserPref = malloc( cols * prefs * sizeof(int) );
+	sup1 = malloc( rows * sizeof(int) );
+	sup2 = malloc( rows * sizeof(int) );
+	weight1 = malloc( rows * sizeof(float) );
+	weight2 = malloc( rows * sizeof(float) );
+	planted = malloc( rows * sizeof(int) );
+	load = calloc( numLec, sizeof(double) );
+	fileName = malloc( strlen( argv[optind+3] ) + 32 );
+	if ( popularity == NULL || order == NULL || pairProj == NULL || projStart == NULL || chooser == NULL || chooserPref == NULL || sup1 == NULL || sup2 == NULL || weight1 == NULL || weight2 == NULL || planted == NULL || load == NULL || fileName == NULL ) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	/* shuffle the projects (Fisher-Yates), then give the r-th weight 1/r^skew */
+	for ( j = 0; j < rows; j++ ) {
+		order[j] = j;
+	}
+	for ( j = rows - 1; j > 0; j-- ) {
+		k = (int) ( uniform() * ( j + 1 ) );
+		t = order[j];
+		order[j] = order[k];
+		order[k] = t;
+	}
+	for ( j = 0; j < rows; j++ ) {
+		popularity[order[j]] = 1 / pow( j + 1, skew );
+	}
+	for ( j = 1; j < rows; j++ ) {
+		popularity[j] += popularity[j-1];
+	}
+
+	/* shuffle again, and plant pair i on the i-th project */
+	if ( rows < cols ) {
+		fprintf(stderr, "Warning: fewer projects than pairs, so there is no allocation without clashes\n");
+	}
+	for ( j = rows - 1; j > 0; j-- ) {
+		k = (int) ( uniform() * ( j + 1 ) );
+		t = order[j];
+		order[j] = order[k];
+		order[k] = t;
+	}
+	for ( j = 0; j < rows; j++ ) {
+		planted[order[j]] = ( j < cols ) ? j : -1;
+	}
+
+	/* each pair picks prefs different projects, the first its planted one. Picking one already picked just picks again.
+	   Then the planted one swaps to a random rank */
+	for ( i = 0; i < cols; i++ ) {
+		for ( k = 0; k < prefs; k++ ) {
+			if ( k == 0 && i < rows ) {
+				p = order[i];
+			} else {
+				do {
+					p = pick( popularity, rows );
+					for ( t = 0; t < k && pairProj[i*prefs + t] != p; t++ );
+				} while ( t < k );
+			}
+			pairProj[i*prefs + k] = p;
+			projStart[p+1]++;
+		}
+		k = (int) ( uniform() * prefs );
+		t = pairProj[i*prefs];
+		pairProj[i*prefs] = pairProj[i*prefs + k];
+		pairProj[i*prefs + k] = t;
+	}
+	for ( j = 0; j < rows; j++ ) { /* counting sort, as in buildChoosers */
+		projStart[j+1] += projStart[j];
+	}
+	for ( i = 0; i < cols; i++ ) {
+		for ( k = 0; k < prefs; k++ ) {
+			p = pairProj[i*prefs + k];
+			chooser[projStart[p]] = i;
+			chooserPref[projStart[p]] = k + 1;
+			projStart[p]++;
+		}
+	}
+	for ( j = rows; j > 0; j-- ) {
+		projStart[j] = projStart[j-1];
+	}
+	projStart[0] = 0;
+
+	/* deal the projects out to the lecturers in turn, the planted ones first so they are spread evenly, and add second supervisors */
+	for ( j = 0; j < rows; j++ ) {
+		p = order[j];
+		sup1[p] = j % numLec;
+		weight1[p] = weights[(int) ( uniform() * numWeights )];
+		if ( planted[p] >= 0 ) {
+			load[sup1[p]] += weight1[p];
+		}
+	}
+	for ( i = 0; i < numLec; i++ ) {
+		if ( load[i] > 1 + LOAD_TOLERANCE ) {
+			fprintf(stderr, "Warning: too many pairs per lecturer for the planted allocation to fit, there may be no allocation breaking no constraints\n");
+			break;
+		}
+	}
+	for ( j = 0; j < rows; j++ ) {
+		p = order[j];
+		sup2[p] = -1;
+		if ( uniform() < cosupervise ) {
+			do {
+				sup2[p] = (int) ( uniform() * numLec );
+			} while ( sup2[p] == sup1[p] );
+			weight2[p] = weights[(int) ( uniform() * numWeights )];
+			if ( planted[p] >= 0 ) {
+				if ( load[sup2[p]] + weight2[p] > 1 + LOAD_TOLERANCE ) {
+					sup2[p] = -1; /* would overload them in the planted allocation */
+				} else {
+					load[sup2[p]] += weight2[p];
+				}
+			}
+		}
+	}
+
+	sprintf( fileName, "%s_choices.csv", argv[optind+3] );
+	file = fopen( fileName, "w" );
+	if ( file == NULL ) {
+		fprintf(stderr, "Could not write %s\n", fileName);
+		return 1;
+	}
+	for ( j = 0; j < rows; j++ ) {
+		k = projStart[j];
+		for ( i = 0; i < cols; i++ ) {
+			if ( i > 0 ) {
+				fputc( ',', file );
+			}
+			if ( k < projStart[j+1] && chooser[k] == i ) {
+				fprintf( file, "%d", chooserPref[k] );
+				k++;
+			}
+		}
+		fputc( '\n', file );
+	}
+	fclose( file );
+	printf("Wrote %s\n", fileName);
+
+	sprintf( fileName, "%s_supervisors.csv", argv[optind+3] );
+	file = fopen( fileName, "w" );
+	if ( file == NULL ) {
+		fprintf(stderr, "Could not write %s\n", fileName);
+		return 1;
+	}
+	for ( j = 0; j < rows; j++ ) {
+		for ( i = 0; i < numLec; i++ ) {
+			if ( i > 0 ) {
+				fputc( ',', file );
+			}
+			if ( i == sup1[j] ) {
+				fprintf( file, "%g", weight1[j] );
+			} else if ( i == sup2[j] ) {
+				fprintf( file, "%g", weight2[j] );
+			}
+		}
+		fputc( '\n', file );
+	}
+	fclose( file );
+	printf("Wrote %s\n", fileName);
+
+	free( popularity );
+	free( order );
+	free( pairProj );
+	free( projStart );
+	free( chooser );
+	free( chooserPref );
+	free( sup1 );
+	free( sup2 );
+	free( weight1 );
+	free( weight2 );
+	free( planted );
+	free( load );
+	free( fileName );
+	free_random_generator_r( &gen );
+	return 0;
+}
+
+void usage( char *program ) {
+	fprintf(stderr, "Usage: %s [options] pairs projects lecturers prefix\n", program);
+	fprintf(stderr, "  --seed S         seed for the random numbers (default %ld)\n", seed);
+	fprintf(stderr, "  --skew S         Zipf exponent of project popularity, 0 for none (default %g)\n", skew);
+	fprintf(stderr, "  --prefs K        projects each pair ranks (default %d)\n", prefs);
+	fprintf(stderr, "  --cosupervise P  chance a project has a second supervisor (default %g)\n", cosupervise);
+	fprintf(stderr, "  --weights W,...  the weightings a supervision can have, picked at random (default 0.25,0.5)\n");
+}
+
+/* RETURNS a random number in [0,1), refilling the buffer when it runs out */
+double uniform( void ) {
+	if ( genCursor == GEN_BUFFER ) {
+		vector_random_generator_int_r( &gen, GEN_BUFFER, genBuffer );
+		genCursor = 0;
+	}
+	return genBuffer[genCursor++] / RAND_RANGE;
+}
+
+/* cumulative[j] is the total weight of 0 to j. RETURNS j with chance in proportion to its weight, found by bisection */
+int pick( double *cumulative, int n ) {
+	double r = uniform() * cumulative[n-1];
+	int low = 0, high = n - 1, mid;
+	while ( low < high ) {
+		mid = ( low + high ) / 2;
+		if ( r < cumulative[mid] ) {
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
+	return low;
+}
+
+/* RETURNS 0 if list is 1 to MAX_WEIGHTS numbers above 0 and up to 1, separated by commas, else -1 */
+int readWeights( char *list ) {
+	char *end;
+	numWeights = 0;
+	while ( numWeights < MAX_WEIGHTS ) {
+		weights[numWeights] = strtod( list, &end );
+		if ( end == list || weights[numWeights] <= 0 || weights[numWeights] > 1 ) {
+			return -1;
+		}
+		numWeights++;
+		if ( *end == '\0' ) {
+			return 0;
+		}
+		if ( *end != ',' ) {
+			return -1;
+		}
+		list = end + 1;
+	}
+	return -1;
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  Compiled instances: a problem saved as it is in memory, so it can be used again without reading the     */
+/*  csv files. compile.out writes one from a choices file and a supervisors file.                           */
+/*    All of a problem's choices and supervisors are in its arena, laid out by allocChoices and             */
+/*    allocSupervisors from the sizes alone. So the file is a header with the sizes and checksums, and then */
+/*    the arena byte for byte. Loading it maps the file into memory and points an arena at it, and the      */
+/*    same two functions then find every array in place: nothing is parsed or copied, and processes using   */
+/*    the same file share the one copy of it the operating system has cached.                               */
+/*    Before it is used the checksums are checked and the arrays are checked to point within each other,    */
+/*    every pair to have chosen something and the workloads to be from 0 to 1, as the annealing takes them  */
+/*    on trust. The file is only meant for machines with the same byte order and sizes of int and float as  */
+/*    the one that wrote it, which the header records.                                                      */
+/************************************************************************************************************/
+
+#define INSTANCE_MAGIC "SPAINST" /* first 8 bytes of every compiled instance, with the 0 at the end */
+#define INSTANCE_VERSION 1 /* changed whenever the layout of the arena changes */
+#define BYTE_ORDER_MARK 0x01020304
+
+/* The start of the file. 64 bytes, so the arena after it is as aligned as arenaAlloc expects. */
+struct instanceHeader {
+	char magic[8];
+	int version;
+	int byteOrder; /* BYTE_ORDER_MARK as the writer had it */
+	int intSize, floatSize;
+	int rows, cols, numLec, links; /* as in struct problem and struct supervisors */
+	long long dataBytes; /* the arena */
+	unsigned long long dataSum; /* checksum of the arena */
+	unsigned long long headerSum; /* checksum of everything above */
+};
+
+unsigned long long checksum( const void *data, size_t bytes ); /* FNV-1a */
+int checkStarts( int *start, int count, int total ); /* 1 if start[] runs from 0 up to total without going down */
+int checkRange( int *values, int count, int low, int high ); /* 1 if every value is from low to high-1 */
+int checkInstance( struct problem *problem ); /* 1 if every array of the problem points within the others, and it is a problem the csv files could have given */
+
+/* 64 bit FNV-1a, 8 bytes at a time. bytes is always a multiple of 8 here. RETURNS the checksum */
+unsigned long long checksum( const void *data, size_t bytes ) {
+	const unsigned long long *word = data;
+	unsigned long long sum = 14695981039346656037ULL;
+	size_t i;
+	for ( i = 0; i < bytes / 8; i++ ) {
+		sum = ( sum ^ word[i] ) * 1099511628211ULL;
+	}
+	return sum;
+}
+
+/* Writes problem to fileName, under another name first and then renamed over it, so nobody mapping the old file sees it half written. RETURNS 0, or -1 with the error written */
+int spaCompileProblem( struct problem *problem, char *fileName, char error[ERROR_LENGTH] ) {
+	struct instanceHeader header;
+	char tempName[FILENAME_MAX];
+	FILE *file;
+	int ok;
+
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.magic, INSTANCE_MAGIC, sizeof(header.magic) );
+	header.version = INSTANCE_VERSION;
+	header.byteOrder = BYTE_ORDER_MARK;
+	header.intSize = sizeof(int);
+	header.floatSize = sizeof(float);
+	header.rows = problem->rows;
+	header.cols = problem->cols;
+	header.numLec = problem->numLec;
+	header.links = problem->sups.links;
+	header.dataBytes = problem->arena.used;
+	header.dataSum = checksum( problem->arena.base, problem->arena.used );
+	header.headerSum = checksum( &header, offsetof( struct instanceHeader, headerSum ) );
+
+	snprintf( tempName, sizeof(tempName), "%s.tmp", fileName );
+	file = fopen( tempName, "wb" );
+	if ( file == NULL ) {
+		snprintf( error, ERROR_LENGTH, "Could not write %s: %s", fileName, strerror( errno ) );
+		return -1;
+	}
+	ok = fwrite( &header, sizeof(header), 1, file ) == 1
+		&& fwrite( problem->arena.base, 1, problem->arena.used, file ) == problem->arena.used;
+	ok = ok && fflush( file ) == 0 && fsync( fileno( file ) ) == 0;
+	if ( fclose( file ) != 0 || !ok || rename( tempName, fileName ) != 0 ) {
+		snprintf( error, ERROR_LENGTH, "Could not write %s: %s", fileName, strerror( errno ) );
+		remove( tempName );
+		return -1;
+	}
+	return 0;
+}
+
+/* Maps a compiled instance into memory and makes a problem of it, in place. spaFreeProblem unmaps it. RETURNS the problem, or NULL with the error written */
+struct problem *spaLoadCompiled( char *fileName, char error[ERROR_LENGTH] ) {
+	struct instanceHeader *header;
+	struct problem *problem;
+	struct stat status;
+	void *mapping;
+	size_t bytes;
+	int fd;
+
+	fd = open( fileName, O_RDONLY );
+	if ( fd < 0 ) {
+		snprintf( error, ERROR_LENGTH, "Could not open %s: %s", fileName, strerror( errno ) );
+		return NULL;
+	}
+	if ( fstat( fd, &status ) != 0 || status.st_size < (off_t) sizeof(struct instanceHeader) ) {
+		snprintf( error, ERROR_LENGTH, "%s is not a compiled instance: it is too short", fileName );
+		close( fd );
+		return NULL;
+	}
+	bytes = status.st_size;
+	mapping = mmap( NULL, bytes, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd ); /* the mapping keeps the file */
+	if ( mapping == MAP_FAILED ) {
+		snprintf( error, ERROR_LENGTH, "Could not map %s: %s", fileName, strerror( errno ) );
+		return NULL;
+	}
+	header = mapping;
+	problem = malloc( sizeof(struct problem) );
+	if ( problem == NULL ) {
+		snprintf( error, ERROR_LENGTH, "Out of memory" );
+		munmap( mapping, bytes );
+		return NULL;
+	}
+	problem->mapping = mapping;
+	problem->mappedBytes = bytes;
+
+	if ( memcmp( header->magic, INSTANCE_MAGIC, sizeof(header->magic) ) != 0 ) {
+		snprintf( error, ERROR_LENGTH, "%s is not a compiled instance. Make one with compile.out", fileName );
+	} else if ( header->version != INSTANCE_VERSION ) {
+		snprintf( error, ERROR_LENGTH, "%s is version %d of the format, but this is version %d. Compile it again", fileName, header->version, INSTANCE_VERSION );
+	} else if ( header->byteOrder != BYTE_ORDER_MARK || header->intSize != sizeof(int) || header->floatSize != sizeof(float) ) {
+		snprintf( error, ERROR_LENGTH, "%s was compiled on a different kind of machine. Compile it again here", fileName );
+	} else if ( header->headerSum != checksum( header, offsetof( struct instanceHeader, headerSum ) ) ) {
+		snprintf( error, ERROR_LENGTH, "%s is corrupt: the checksum of its header is wrong", fileName );
+	} else {
+		problem->rows = header->rows;
+		problem->cols = header->cols;
+		problem->numLec = header->numLec;
+		if ( problem->rows < 1 || problem->cols < 1 || problem->numLec < 1 || header->links < 0
+			|| header->dataBytes != (long long) problemBytes( problem, header->links ) || bytes != sizeof(struct instanceHeader) + header->dataBytes ) {
+			snprintf( error, ERROR_LENGTH, "%s is corrupt: its sizes do not add up", fileName );
+		} else if ( header->dataSum != checksum( header + 1, header->dataBytes ) ) {
+			snprintf( error, ERROR_LENGTH, "%s is corrupt: the checksum of its data is wrong", fileName );
+		} else {
+			problem->arena.base = (char *) ( header + 1 );
+			problem->arena.size = header->dataBytes;
+			problem->arena.used = 0;
+			allocChoices( problem );
+			allocSupervisors( problem, header->links );
+			if ( checkInstance( problem ) ) {
+				return problem;
+			}
+			snprintf( error, ERROR_LENGTH, "%s is corrupt: its choices or supervisors point outside the problem, a pair has no choices or a workload is not from 0 to 1", fileName );
+		}
+	}
+	spaFreeProblem( problem );
+	return NULL;
+}
+
+int checkStarts( int *start, int count, int total ) {
+	int i;
+	if ( start[0] != 0 || start[count] != total ) {
+		return 0;
+	}
+	for ( i = 0; i < count; i++ ) {
+		if ( start[i+1] < start[i] ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int checkRange( int *values, int count, int low, int high ) {
+	int i;
+	for ( i = 0; i < count; i++ ) {
+		if ( values[i] < low || values[i] >= high ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Everything the annealing indexes with: the projects the pairs chose, the choosers of every project, and both ways round of the supervisors.
+   And what readChoices and the weighting parser would have turned away, which the annealing relies on too: every pair chose some project (or a starting configuration
+   is never found for it), and every workload is from 0 to 1. */
+int checkInstance( struct problem *problem ) {
+	struct choices *choices = &problem->choices;
+	struct supervisors *sups = &problem->sups;
+	int chosen, pair, k;
+	if ( !checkRange( &choices->prefProj[0][0], problem->cols * NUMPREFS, -1, problem->rows ) ) {
+		return 0;
+	}
+	for ( pair = 0; pair < problem->cols; pair++ ) {
+		for ( k = 0; k < NUMPREFS && choices->prefProj[pair][k] < 0; k++ );
+		if ( k == NUMPREFS ) {
+			return 0;
+		}
+	}
+	for ( k = 0; k < sups->links; k++ ) {
+		if ( !( sups->weight[k] >= 0 && sups->weight[k] <= 1 ) ) { /* so NaN fails too */
+			return 0;
+		}
+	}
+	chosen = choices->chooserStart[problem->rows];
+	if ( chosen < 0 || chosen > problem->cols * NUMPREFS || !checkStarts( choices->chooserStart, problem->rows, chosen )
+		|| !checkRange( choices->chooser, chosen, 0, problem->cols ) || !checkRange( choices->chooserPref, chosen, 1, NUMPREFS + 1 ) ) {
+		return 0;
+	}
+	return checkStarts( sups->projStart, problem->rows, sups->links ) && checkRange( sups->lec, sups->links, 0, problem->numLec )
+		&& checkStarts( sups->lecStart, problem->numLec, sups->links ) && checkRange( sups->proj, sups->links, 0, problem->rows );
+}
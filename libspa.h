@@ -0,0 +1,117 @@
+/************************************************************************************************************/
+/*  libspa: the student-project allocation solver as a library.                                             */
+/*    A problem is read in once with spaLoadProblem and never changed after, so any number of solvers,      */
+/*    on any number of threads, can share it. A solver is one run on a problem: its settings, its random    */
+/*    numbers and its allocation, with nothing shared with any other solver. So                             */
+/*                                                                                                          */
+/*        struct settings settings;                                                                         */
+/*        spaDefaults( &settings );                                                                         */
+/*        settings.seed = 42;                                                                               */
+/*        problem = spaLoadProblem( "choices.csv", "supervisors.csv", error );                              */
+/*        solver = spaNewSolver( problem, &settings, stdout, error );                                       */
+/*        spaSolve( solver, "newData.txt", error );                                                         */
+/*        spaWriteAllocation( solver, "finalConfig.txt" );                                                  */
+/*        spaFreeSolver( solver );                                                                          */
+/*        spaFreeProblem( problem );                                                                        */
+/*                                                                                                          */
+/*    is what spa.out does (see Program.c), and running several solvers at once is just doing the same on   */
+/*    several threads. Every function that can fail RETURNS 0 (or a pointer), or -1 (or NULL) with what     */
+/*    went wrong written in error.                                                                          */
+/************************************************************************************************************/
+
+#ifndef LIBSPA_H
+#define LIBSPA_H
+
+#include <stdio.h>
+
+#define NUMPREFS 4 /* each pair ranks at most this many projects */
+#define ERROR_LENGTH 256 /* room for an error message */
+#define SCHEDULE_LINEAR 0 /* the cooling schedules anneal can follow */
+#define SCHEDULE_GEOMETRIC 1
+#define SCHEDULE_ADAPTIVE 2
+#define MOVE_SINGLE 0 /* the kinds of move. See proposeMove in anneal.c */
+#define MOVE_SWAP 1
+#define MOVE_EJECT 2
+#define MOVE_KINDS 3
+#define KERNEL_OFF 0 /* how single moves are priced. See blockmoves.c */
+#define KERNEL_SCALAR 1
+#define KERNEL_SSE 2
+#define KERNEL_AVX2 3
+#define KERNEL_AUTO 4
+#define RNG_RANVEC 0 /* the random number generators a run can use */
+#define RNG_PHILOX 1
+#define RNG_KINDS 2
+
+struct problem; /* the choices and supervisors of one cohort */
+struct solver; /* one run on a problem */
+
+/* Everything about how a problem is solved. spaDefaults fills in the defaults, which are given there. */
+struct settings {
+	long int seed; /* seed for the random numbers. 0 takes it from the time, anything else makes the run repeatable */
+	int generator; /* which makes them, one of the RNG_s:
+		ranvec - the shift-register generator in ranvec.c, with chain i seeded seed+i.
+		philox - the counter-based generator in philox.c, with chain i on stream i of seed, so no two chains can ever overlap. */
+	float score[NUMPREFS]; /* how much each preference is worth (out of 5). The energy weights are worked out from these */
+	int schedule; /* how the temperature comes down, one of the SCHEDULE_s:
+		linear - by coolStep every level, from startTemp to 0. The schedule in the paper.
+		geometric - times cooling every level, from startTemp to endTemp.
+		adaptive - as geometric while more than targetAccept of the moves at a level are accepted, and half as fast (times the square root of cooling) once fewer are, which is where the allocation is settling. */
+	double startTemp; /* starting temperature. 0 works it out from the starting configuration, see calibrateTemp */
+	double endTemp; /* geometric and adaptive stop below this */
+	double coolStep; /* linear: how much temp drops each level */
+	double cooling; /* geometric and adaptive: what temp is multiplied by each level */
+	double targetAccept; /* the acceptance rate below which the allocation is taken to be settling down: adaptive cools more slowly, and frozenLevels starts counting */
+	int frozenLevels; /* if > 0, stop once this many settled temperatures in a row have not improved on the best energy. 0 never stops early */
+	double rejectionFree; /* once fewer than this fraction of the moves at a temperature are accepted, switch to rejection-free moves (see nfold.c) for the rest of the run. Only with single moves. 0 never switches */
+	double moveMix[MOVE_KINDS]; /* how often each kind of move is tried, relative to the others: single, swap and eject (see proposeMove) */
+	int kernel; /* how single moves are tried, one of the KERNEL_s:
+		off - each one is made, checked and undone in turn. The moves in the paper.
+		scalar, sse, avx2 - a block of them is drawn and priced together, 1, 4 or 8 at a time, without making any, and only accepted ones are made (see blockmoves.c). All three go exactly the same way, just faster. spaNewSolver fails if the CPU cannot run the one asked for.
+		auto - whichever of those the CPU can run is quickest, timed on the first block. */
+	double targetEnergy; /* unless NAN, stop once any chain gets down to this, and report the time it took at the end. Energies can be any sign, with scores of any sign */
+	double timeLimit; /* if > 0, the run is done within this many seconds: the cooling is sped up to fit, and stops in time if it must. 0 never stops early */
+	int logEvery; /* a line of telemetry is written every logEvery temperatures, adding up the moves since the last line. 0 writes none */
+	int progressEvery; /* the temperature and energy are printed every progressEvery temperatures. 0 prints none */
+	double checkpointEvery; /* if > 0, the single annealing chain is saved to checkpointFile every this many seconds, so it can be carried on with resume if it gets killed */
+	char *checkpointFile;
+	int resume; /* 1 to carry on from checkpointFile rather than start afresh */
+	int boundIterations; /* rounds of pricing to work out a lower bound on the energy with (see flow.c). The gap to it is reported, and annealing stops if it is reached. 0 works none out */
+	int warmStart; /* 1 to start the single annealing chain from the best allocation the lower bound found, rather than a random one */
+	char *previousFile; /* an earlier finalConfig.txt to start the single annealing chain from, changing it as little as the edited files allow (see previous.c). NULL for none */
+	double previousTemp; /* the starting temperature with previousFile, as a fraction of the energy of a first choice (which shrinks as the pairs grow). Cold enough that nearly every move made lowers the energy. 0 uses startTemp instead */
+	int chains; /* number of independent annealing chains. The best is kept */
+	int threads; /* threads to run the chains on. 0 is one per core */
+	char *chainSummary; /* where the energy every chain ends on is written. NULL for nowhere */
+	int replicas; /* number of replicas (and threads) for parallel tempering. 0 runs the single annealing chain */
+	int rounds; /* parallel tempering: how many cycles of moves each replica does, with a round of swaps after each */
+	double minTemp; /* parallel tempering: the coldest and hottest temperatures. The rest are spaced geometrically between */
+	double maxTemp;
+	int driftCheck; /* if > 0, the running energy is checked against a full recompute every driftCheck moves. 0 turns the check off */
+};
+
+/* How solving one problem went. */
+struct result {
+	int status; /* 0 if it was solved */
+	int pairs, projects, supervisors;
+	float energy;
+	double bound; /* the lower bound on the energy, -HUGE_VAL if none was worked out */
+	long int moves;
+	double seconds;
+};
+
+void spaDefaults( struct settings *settings ); /* the settings spa.out has with no options */
+struct problem *spaLoadProblem( char *choicesName, char *supervisorsName, char error[ERROR_LENGTH] ); /* reads in the two csv files */
+struct problem *spaLoadCompiled( char *fileName, char error[ERROR_LENGTH] ); /* maps in a problem compile.out made, using it where it is */
+int spaCompileProblem( struct problem *problem, char *fileName, char error[ERROR_LENGTH] ); /* saves problem for spaLoadCompiled */
+void spaProblemSize( struct problem *problem, int *projects, int *pairs, int *supervisors );
+void spaFreeProblem( struct problem *problem ); /* once no solver is using it */
+struct solver *spaNewSolver( struct problem *problem, struct settings *settings, FILE *out, char error[ERROR_LENGTH] ); /* gets ready to solve problem, printing how it goes to out (NULL for nowhere). settings is copied, and used as it is: main in Program.c checks what makes sense */
+int spaSolve( struct solver *solver, char *dataName, char error[ERROR_LENGTH] ); /* anneals, writing the telemetry to dataName (NULL for none) */
+void spaInterrupt( struct solver *solver ); /* makes spaSolve stop early with the best allocation found so far. Safe in a signal handler */
+void spaGetResult( struct solver *solver, struct result *result );
+void spaGetAllocation( struct solver *solver, int projNum[], int projPref[] ); /* the project (from 0) each pair has, and its preference for it (from 1) */
+int spaWriteAllocation( struct solver *solver, char *configName ); /* adds the allocation on to configName, as pair,project,preference lines counted from 1 */
+void spaFreeSolver( struct solver *solver );
+int spaTestGenerators( long int seed, long int count, FILE *out ); /* a statistical check of both generators, printed to out. RETURNS 0 if they passed */
+
+#endif
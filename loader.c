@@ -0,0 +1,363 @@
+/************************************************************************************************************/
+/*  Reading in the two csv files.                                                                           */
+/*                                                                                                          */
+/*  Each file is memory mapped and parsed in one pass into a csvTable, which is just the list of its        */
+/*  filled in cells (row, column, value) in file order, plus how many rows and columns it has. Nothing      */
+/*  else is copied. readChoices and readLecturers then put those cells straight into struct choices and    */
+/*  the problem once makeProblem has made room for them.                                                    */
+/*                                                                                                          */
+/*  Every cell is checked on the way in. A mistake in a file stops the run with the file, row and column   */
+/*  it is in (counted from 1, the way a spreadsheet shows them) rather than being skipped over.            */
+/*                                                                                                          */
+/*  The rules are:                                                                                          */
+/*    * if the first cell of the first row has text in it (not a number), the first column is a dummy      */
+/*      column of labels and is skipped on every row.                                                       */
+/*    * in the choices file every other cell is empty or a preference from 1 to NUMPREFS.                   */
+/*    * in the supervisors file every other cell is empty or a decimal weighting from 0 to 1.              */
+/*    * every row has the same number of cells. Empty lines at the end of the file are ignored.             */
+/************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spa.h"
+
+#define MAX_DECIMALS 9 /* most digits after the decimal point that parseWeight will take */
+
+static const float tenths[MAX_DECIMALS + 1] = { 1e0f, 1e-1f, 1e-2f, 1e-3f, 1e-4f, 1e-5f, 1e-6f, 1e-7f, 1e-8f, 1e-9f };
+
+static int parseLine( const char *line, const char *end, int kind, struct csvTable *table, char *error );
+static int parsePref( const char *cell, const char *end, float *value );
+static int parseWeight( const char *cell, const char *end, float *value );
+static int addCell( struct csvTable *table, int col, float value );
+
+/* Reads the csv file fileName into table. kind is CSV_CHOICES or CSV_SUPERVISORS and says what the cells should hold.
+   RETURNS 0 if all went well. Otherwise -1, with what went wrong written in error. */
+int loadCsv( char *fileName, int kind, struct csvTable *table, char *error ) {
+	int fd;
+	struct stat info;
+	char *text; /* the whole file */
+	const char *line, *end, *next; /* start and end of the line being read, and where the one after starts */
+	int blankLine = 0; /* line number of the first empty line, in case more data follows it */
+
+	table->fileName = fileName;
+	table->rows = 0;
+	table->cells = -1; /* not known until the first row is read */
+	table->label = -1; /* likewise */
+	table->filled = 0;
+	table->capacity = 0;
+	table->row = NULL;
+	table->col = NULL;
+	table->value = NULL;
+
+	fd = open( fileName, O_RDONLY );
+	if ( fd < 0 ) {
+		snprintf( error, ERROR_LENGTH, "Could not open %s", fileName );
+		return -1;
+	}
+	if ( fstat( fd, &info ) != 0 || info.st_size == 0 ) {
+		snprintf( error, ERROR_LENGTH, "%s is empty", fileName );
+		close( fd );
+		return -1;
+	}
+	text = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( text == MAP_FAILED ) {
+		snprintf( error, ERROR_LENGTH, "Could not map %s", fileName );
+		return -1;
+	}
+	madvise( text, info.st_size, MADV_SEQUENTIAL );
+
+	for ( line = text; line < text + info.st_size; line = next ) {
+		end = memchr( line, '\n', text + info.st_size - line );
+		if ( end == NULL ) { /* last line with no new line after it */
+			end = text + info.st_size;
+			next = end;
+		} else {
+			next = end + 1;
+		}
+		if ( end > line && end[-1] == '\r' ) { /* the end of lines from Excel have one of these before the new line */
+			end--;
+		}
+		if ( end == line ) { /* only allowed at the end, which we will not know until we get there */
+			if ( blankLine == 0 ) {
+				blankLine = table->rows + 1;
+			}
+			continue;
+		}
+		if ( blankLine > 0 ) {
+			snprintf( error, ERROR_LENGTH, "%s: row %d is empty", fileName, blankLine );
+			break;
+		}
+		if ( parseLine( line, end, kind, table, error ) != 0 ) {
+			break;
+		}
+		table->rows++;
+	}
+
+	munmap( text, info.st_size );
+	if ( line < text + info.st_size ) { /* stopped early */
+		freeCsv( table );
+		return -1;
+	}
+	if ( table->rows == 0 ) {
+		snprintf( error, ERROR_LENGTH, "%s has no rows", fileName );
+		freeCsv( table );
+		return -1;
+	}
+	return 0;
+}
+
+void freeCsv( struct csvTable *table ) {
+	free( table->row );
+	free( table->col );
+	free( table->value );
+	table->row = NULL;
+	table->col = NULL;
+	table->value = NULL;
+}
+
+/* Reads the cells of one line, from line up to (not including) end, onto the table. RETURNS 0, or -1 with the error written. */
+static int parseLine( const char *line, const char *end, int kind, struct csvTable *table, char *error ) {
+	const char *cell, *cellEnd;
+	int col = 0; /* column in the file */
+	int cells = 0; /* data cells, so not counting the labels */
+	float value;
+	int ok;
+
+	for ( cell = line; ; cell = cellEnd + 1 ) {
+		cellEnd = memchr( cell, ',', end - cell );
+		if ( cellEnd == NULL ) {
+			cellEnd = end;
+		}
+		if ( col == 0 && table->label < 0 ) { /* first cell of the file decides whether there is a label column */
+			table->label = cellEnd > cell && !( ( *cell >= '0' && *cell <= '9' ) || *cell == '.' || *cell == ' ' );
+		}
+		if ( col == 0 && table->label ) { /* skip the label */
+			col++;
+			if ( cellEnd == end ) {
+				break;
+			}
+			continue;
+		}
+		ok = kind == CSV_CHOICES ? parsePref( cell, cellEnd, &value ) : parseWeight( cell, cellEnd, &value );
+		if ( !ok && kind == CSV_CHOICES ) {
+			snprintf( error, ERROR_LENGTH, "%s: row %d, column %d: \"%.*s\" is not a preference from 1 to %d", table->fileName, table->rows + 1, col + 1,
+				(int) ( cellEnd - cell < 20 ? cellEnd - cell : 20 ), cell, NUMPREFS );
+			return -1;
+		} else if ( !ok ) {
+			snprintf( error, ERROR_LENGTH, "%s: row %d, column %d: \"%.*s\" is not a weighting from 0 to 1", table->fileName, table->rows + 1, col + 1,
+				(int) ( cellEnd - cell < 20 ? cellEnd - cell : 20 ), cell );
+			return -1;
+		}
+		if ( value > 0 && addCell( table, cells, value ) != 0 ) {
+			snprintf( error, ERROR_LENGTH, "Out of memory reading %s", table->fileName );
+			return -1;
+		}
+		col++;
+		cells++;
+		if ( cellEnd == end ) {
+			break;
+		}
+	}
+
+	if ( table->cells < 0 ) {
+		table->cells = cells;
+	} else if ( cells != table->cells ) {
+		snprintf( error, ERROR_LENGTH, "%s: row %d has %d columns but row 1 has %d", table->fileName, table->rows + 1, col, table->cells + table->label );
+		return -1;
+	}
+	return 0;
+}
+
+/* A preference is a single digit from 1 to NUMPREFS, maybe with spaces round it. An empty cell is a preference of 0. RETURNS 1 if the cell is one of these */
+static int parsePref( const char *cell, const char *end, float *value ) {
+	while ( cell < end && *cell == ' ' ) {
+		cell++;
+	}
+	while ( end > cell && end[-1] == ' ' ) {
+		end--;
+	}
+	if ( cell == end ) {
+		*value = 0;
+		return 1;
+	}
+	if ( end - cell == 1 && *cell >= '1' && *cell <= '0' + NUMPREFS ) {
+		*value = *cell - '0';
+		return 1;
+	}
+	return 0;
+}
+
+/* A weighting is a decimal like 1, 0.5 or .25 between 0 and 1, maybe with spaces round it. An empty cell is a weighting of 0.
+   The digits are gathered into one whole number and scaled once at the end, so there is no rounding along the way. RETURNS 1 if the cell is one of these */
+static int parseWeight( const char *cell, const char *end, float *value ) {
+	long int digits = 0;
+	int decimals = -1; /* digits after the point, -1 before the point is seen */
+	int any = 0;
+	while ( cell < end && *cell == ' ' ) {
+		cell++;
+	}
+	while ( end > cell && end[-1] == ' ' ) {
+		end--;
+	}
+	for ( ; cell < end; cell++ ) {
+		if ( *cell >= '0' && *cell <= '9' ) {
+			if ( decimals == MAX_DECIMALS || digits > 100000000 ) {
+				return 0;
+			}
+			digits = 10 * digits + ( *cell - '0' );
+			any = 1;
+			if ( decimals >= 0 ) {
+				decimals++;
+			}
+		} else if ( *cell == '.' && decimals < 0 ) {
+			decimals = 0;
+		} else {
+			return 0;
+		}
+	}
+	if ( decimals < 0 ) {
+		decimals = 0;
+	}
+	if ( !any && decimals > 0 ) {
+		return 0;
+	}
+	*value = digits * tenths[decimals];
+	return *value <= 1;
+}
+
+/* adds a filled in cell of the current row to the table, making more room when needed. RETURNS 0, or -1 if there is no more memory */
+static int addCell( struct csvTable *table, int col, float value ) {
+	int capacity;
+	if ( table->filled == table->capacity ) {
+		capacity = table->capacity > 0 ? 2 * table->capacity : 1024;
+		if ( ( table->row = realloc( table->row, capacity * sizeof(int) ) ) == NULL
+			|| ( table->col = realloc( table->col, capacity * sizeof(int) ) ) == NULL
+			|| ( table->value = realloc( table->value, capacity * sizeof(float) ) ) == NULL ) {
+			return -1;
+		}
+		table->capacity = capacity;
+	}
+	table->row[table->filled] = table->rows;
+	table->col[table->filled] = col;
+	table->value[table->filled] = value;
+	table->filled++;
+	return 0;
+}
+
+/* puts the cells of the choices file into the problem's choices - cell (y, z) holding x means pair z gave project y preference x.
+   Checks every pair has chosen something, and has not given the same preference twice. RETURNS 0, or -1 with the error written */
+int readChoices( struct csvTable *table, struct problem *problem, char *error ) {
+	struct choices *choices = &problem->choices;
+	int cols = problem->cols;
+	int i, k, pair, pref;
+	for ( pair=0; pair<cols; pair++ ) {
+		for ( k=0; k<NUMPREFS; k++ ) {
+			choices->prefProj[pair][k] = -1;
+		}
+	}
+	for ( i=0; i<table->filled; i++ ) {
+		pair = table->col[i];
+		pref = (int) table->value[i];
+		if ( choices->prefProj[pair][pref-1] >= 0 ) {
+			snprintf( error, ERROR_LENGTH, "%s: column %d gives preference %d to both row %d and row %d", table->fileName,
+				pair + 1 + table->label, pref, choices->prefProj[pair][pref-1] + 1, table->row[i] + 1 );
+			return -1;
+		}
+		choices->prefProj[pair][pref-1] = table->row[i];
+	}
+	for ( pair=0; pair<cols; pair++ ) {
+		for ( k=0; k<NUMPREFS && choices->prefProj[pair][k] < 0; k++ ) {
+		}
+		if ( k == NUMPREFS ) {
+			snprintf( error, ERROR_LENGTH, "%s: column %d has not chosen any projects", table->fileName, pair + 1 + table->label );
+			return -1;
+		}
+	}
+	buildChoosers( problem );
+	return 0;
+}
+
+/* fills in the list of pairs who chose each project from prefProj. A counting sort, so the pairs come out in order for every project. */
+void buildChoosers( struct problem *problem ) {
+	struct choices *choices = &problem->choices;
+	int rows = problem->rows, cols = problem->cols;
+	int p, k, i;
+	for ( p=0; p<=rows; p++ ) {
+		choices->chooserStart[p] = 0;
+	}
+	for ( i=0; i<cols; i++ ) { /* count the choosers of each project, one place along */
+		for ( k=0; k<NUMPREFS; k++ ) {
+			if ( choices->prefProj[i][k] >= 0 ) {
+				choices->chooserStart[choices->prefProj[i][k]+1]++;
+			}
+		}
+	}
+	for ( p=0; p<rows; p++ ) { /* running total gives where each project's list starts */
+		choices->chooserStart[p+1] += choices->chooserStart[p];
+	}
+	for ( i=0; i<cols; i++ ) { /* chooserStart[p] is used as a cursor here, so it ends up where project p+1 starts... */
+		for ( k=0; k<NUMPREFS; k++ ) {
+			if ( choices->prefProj[i][k] >= 0 ) {
+				p = choices->prefProj[i][k];
+				choices->chooser[choices->chooserStart[p]] = i;
+				choices->chooserPref[choices->chooserStart[p]] = k+1;
+				choices->chooserStart[p]++;
+			}
+		}
+	}
+	for ( p=rows; p>0; p-- ) { /* ...so shift it back */
+		choices->chooserStart[p] = choices->chooserStart[p-1];
+	}
+	choices->chooserStart[0] = 0;
+}
+
+/* puts the cells of the supervisors file into the problem's supervisors. The cells are in row order already, so they are the project -> lecturer side as they are. */
+void readLecturers( struct csvTable *table, struct problem *problem ) {
+	struct supervisors *sups = &problem->sups;
+	int k;
+	sups->links = table->filled;
+	for ( k=0; k<table->filled; k++ ) {
+		sups->lec[k] = table->col[k];
+		sups->weight[k] = table->value[k];
+	}
+	buildLecturerProjects( problem, table->row );
+}
+
+/* works out projStart from the project of each link, and then fills in the lecturer -> project side the same way buildChoosers does. */
+void buildLecturerProjects( struct problem *problem, int *linkProj ) {
+	struct supervisors *sups = &problem->sups;
+	int rows = problem->rows, numLec = problem->numLec;
+	int p, j, k;
+	for ( p=0; p<=rows; p++ ) {
+		sups->projStart[p] = 0;
+	}
+	for ( j=0; j<=numLec; j++ ) {
+		sups->lecStart[j] = 0;
+	}
+	for ( k=0; k<sups->links; k++ ) { /* count the links of each project and lecturer, one place along */
+		sups->projStart[linkProj[k]+1]++;
+		sups->lecStart[sups->lec[k]+1]++;
+	}
+	for ( p=0; p<rows; p++ ) { /* running totals give where each list starts */
+		sups->projStart[p+1] += sups->projStart[p];
+	}
+	for ( j=0; j<numLec; j++ ) {
+		sups->lecStart[j+1] += sups->lecStart[j];
+	}
+	for ( k=0; k<sups->links; k++ ) { /* lecStart[j] is used as a cursor here, so it ends up where lecturer j+1 starts... */
+		j = sups->lec[k];
+		sups->proj[sups->lecStart[j]] = linkProj[k];
+		sups->projWeight[sups->lecStart[j]] = sups->weight[k];
+		sups->lecStart[j]++;
+	}
+	for ( j=numLec; j>0; j-- ) { /* ...so shift it back */
+		sups->lecStart[j] = sups->lecStart[j-1];
+	}
+	sups->lecStart[0] = 0;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  Multi-start annealing.                                                                                  */
+/*    Annealing is random, so two runs rarely end at the same allocation. Rather than running the program   */
+/*    several times by hand and comparing the results, numChains chains are each annealed from their own    */
+/*    starting configuration with their own stream of random numbers, and the best is kept.                 */
+/*    The chains are shared out between numThreads threads: each thread takes the next chain nobody has     */
+/*    started yet until there are none left. The problem is only read, so is shared.                        */
+/*    With a time limit, each chain is given an even share of the time left when it starts, and once the    */
+/*    time is up, the target energy has been reached or the run is interrupted, chains not yet started are  */
+/*    skipped.                                                                                              */
+/*    The energy every chain ends on is written to chainSummary (in the settings).                          */
+/************************************************************************************************************/
+
+/* Everything the threads share. */
+struct multiStart {
+	struct solver *solver; /* the problem in it is read only */
+	int numChains;
+	int numThreads;
+	struct chain *chains;
+	int next; /* the next chain to be started */
+	pthread_mutex_t lock; /* guards next */
+};
+
+void *runChains( void *arg ); /* the work of one thread */
+int poolSize( int numChains, int numThreads ); /* how many threads to actually start */
+
+/* Adds up what multiStart takes off the arena, in the same way as chainBytes. */
+size_t multiStartBytes( struct problem *problem, int numChains, int numThreads ) {
+	if ( numChains <= 1 ) {
+		return 0;
+	}
+	return ARENA_ROUND( numChains * sizeof(struct chain) ) + numChains * chainBytes( problem ) + ARENA_ROUND( poolSize( numChains, numThreads ) * sizeof(pthread_t) );
+}
+
+/* numThreads of 0 means one per core. There is no point having more threads than chains. */
+int poolSize( int numChains, int numThreads ) {
+	if ( numThreads == 0 ) {
+		numThreads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	if ( numThreads < 1 ) {
+		numThreads = 1;
+	}
+	return numThreads < numChains ? numThreads : numChains;
+}
+
+/* Anneals the solver's chains on a pool of threads, then copies the lowest energy allocation into best, along with the moves made by all of them and the first time any got down to the target energy.
+   RETURNS 0, or -1 if no chain found a starting configuration, when best is left alone */
+int multiStart( struct solver *solver, struct chain *best ) {
+	int numChains = solver->settings.chains;
+	long int seed = solver->settings.seed;
+	struct arena *arena = &solver->arena;
+	struct multiStart ms;
+	int numThreads;
+	pthread_t *pool;
+	struct chain *lowest;
+	FILE *summary;
+	int i, found;
+
+	numThreads = poolSize( numChains, solver->settings.threads );
+	ms.solver = solver;
+	ms.numChains = numChains;
+	ms.numThreads = numThreads;
+	ms.chains = arenaAlloc( arena, numChains * sizeof(struct chain) );
+	ms.next = 0;
+	pthread_mutex_init( &ms.lock, NULL );
+	pool = arenaAlloc( arena, numThreads * sizeof(pthread_t) );
+	for ( i = 0; i < numChains; i++ ) {
+		allocChain( &ms.chains[i], solver, i, arena );
+	}
+	report( solver, "Multi-start: %d chains on %d threads\n", numChains, numThreads);
+
+	for ( i = 0; i < numThreads; i++ ) {
+		if ( pthread_create( &pool[i], NULL, runChains, &ms ) != 0 ) {
+			fprintf(stderr, "Could not start thread %d\n", i);
+			exit(1);
+		}
+	}
+	for ( i = 0; i < numThreads; i++ ) {
+		pthread_join( pool[i], NULL );
+	}
+	pthread_mutex_destroy( &ms.lock );
+
+	lowest = &ms.chains[0];
+	summary = solver->settings.chainSummary != NULL ? fopen(solver->settings.chainSummary, "w") : NULL;
+	for ( i = 0; i < numChains; i++ ) {
+		if ( isinf( ms.chains[i].currentEnergy ) ) { /* skipped */
+			continue;
+		}
+		if ( ms.chains[i].currentEnergy < lowest->currentEnergy ) {
+			lowest = &ms.chains[i];
+		}
+		best->moves += ms.chains[i].moves;
+		if ( ms.chains[i].targetTime >= 0 && ( best->targetTime < 0 || ms.chains[i].targetTime < best->targetTime ) ) {
+			best->targetTime = ms.chains[i].targetTime;
+		}
+		if ( summary != NULL ) {
+			fprintf(summary, "%d,%ld,%f\n", i+1, solver->settings.generator == RNG_RANVEC ? seed + i : seed, ms.chains[i].currentEnergy); /* the seed ranvec.c was given, or the one Philox stream i is of */
+		}
+	}
+	if ( summary != NULL ) {
+		fclose(summary);
+	}
+	found = !isinf( lowest->currentEnergy );
+	if ( found ) {
+		report( solver, "Best is chain %d of %d\n", (int) ( lowest - ms.chains ) + 1, numChains);
+		for ( i = 0; i < solver->problem->cols; i++ ) {
+			best->projNum[i] = lowest->projNum[i];
+			best->projPref[i] = lowest->projPref[i];
+		}
+		best->currentEnergy = lowest->currentEnergy;
+	}
+	for ( i = 0; i < numChains; i++ ) {
+		freeChain( &ms.chains[i] );
+	}
+	return found ? 0 : -1;
+}
+
+/* One thread of the pool. Keeps taking the next chain and annealing it until there are none left.
+   With a time limit, the chain gets the time left shared between the rounds of chains the pool still has to do, this one included. The first round always runs, so there is something to
+   show for the run; the chains after it are skipped once there is no point starting them, and left with an infinite energy, as is a chain that finds no starting configuration. */
+void *runChains( void *arg ) {
+	struct multiStart *ms = arg;
+	struct solver *solver = ms->solver;
+	double timeLimit = solver->settings.timeLimit;
+	struct chain *chain;
+	double now;
+	int i, rounds;
+
+	for ( ;; ) {
+		pthread_mutex_lock( &ms->lock );
+		i = ms->next++;
+		pthread_mutex_unlock( &ms->lock );
+		if ( i >= ms->numChains ) {
+			return NULL;
+		}
+		chain = &ms->chains[i];
+		now = wallTime( solver );
+		if ( i >= ms->numThreads && ( solver->interrupted || solver->targetReached || ( timeLimit > 0 && now >= timeLimit ) ) ) {
+			chain->currentEnergy = HUGE_VALF;
+			continue;
+		}
+		if ( timeLimit > 0 ) {
+			rounds = ( ms->numChains - i + ms->numThreads - 1 ) / ms->numThreads;
+			chain->deadline = now + ( timeLimit - now ) / rounds;
+		}
+		if ( createInitialConfiguration( chain ) != 0 ) {
+			report( solver, "Chain %d found no starting configuration\n", i+1);
+			chain->currentEnergy = HUGE_VALF;
+			continue;
+		}
+		anneal( chain, 0, NULL, NULL );
+		report( ms->solver, "Chain %d finished with energy %f\n", i+1, chain->currentEnergy);
+	}
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  Rejection-free (n-fold way, or BKL) moves for the cold end of the annealing.                           */
+/*    At low temperature nearly every single move cycleOfMoves tries is rejected, and the level burns its   */
+/*    whole budget of proposals while hardly anything changes. But there are only a few single moves: each  */
+/*    pair can go to at most NUMPREFS-1 other projects. So instead, every one of them is given the chance    */
+/*    cycleOfMoves would accept it with - 0 if it breaks a constraint, else min(1, exp(-change/temp)) - and  */
+/*    these rates are kept in a sum tree. A move is then picked straight from the tree, in proportion to    */
+/*    its rate, and the number of proposals cycleOfMoves would have made to get to it is drawn as well, so  */
+/*    the level lasts just as long as it would have. The chain goes the same way as it would with           */
+/*    cycleOfMoves, only without the rejections.                                                             */
+/*    After a move only the rates of moves near it change: those of the pair that moved, of the pairs who   */
+/*    chose its old and new projects, and of the pairs who chose a project of any of their supervisors,     */
+/*    whose loads have changed.                                                                              */
+/************************************************************************************************************/
+
+/* The sum tree. sum[1] is the total of all the rates, and sum[i] is sum[2i] + sum[2i+1]. The rate of move k (0 to NUMPREFS-1, the preference less 1) of pair is in sum[leaves + pair*NUMPREFS + k]. */
+
+double moveRate( struct chain *chain, struct choices *choices, int pair, int k, double temp ); /* how likely cycleOfMoves would be to accept the move */
+void setRate( struct rateTree *tree, int slot, double rate ); /* changes one rate and the sums above it */
+void ratePair( struct chain *chain, struct choices *choices, int pair, double temp ); /* works out the rates of all of pair's moves */
+void rateAround( struct chain *chain, struct choices *choices, struct supervisors *sups, int proj, double temp ); /* works out the rates of every move that a change on proj could have changed */
+void rateAll( struct chain *chain, struct choices *choices, double temp ); /* works out the whole tree */
+int pickMove( struct rateTree *tree, double r ); /* finds the move the running total r falls in */
+
+/* The tree has a power of two leaves, at least one for every (pair, preference). */
+int treeLeaves( struct problem *problem ) {
+	int leaves = 1;
+	while ( leaves < problem->cols * NUMPREFS ) {
+		leaves *= 2;
+	}
+	return leaves;
+}
+
+size_t rateTreeBytes( struct problem *problem ) {
+	return ARENA_ROUND( 2 * treeLeaves( problem ) * sizeof(double) );
+}
+
+void allocRateTree( struct rateTree *tree, struct problem *problem, struct arena *arena ) {
+	tree->leaves = treeLeaves( problem );
+	tree->sum = arenaAlloc( arena, 2 * tree->leaves * sizeof(double) );
+}
+
+/* Does all the moves for a fixed temp, as cycleOfMoves does, but without rejecting any. Only single moves are made.
+   There are no rejections to give reasons for, so only moves and accepted are filled in.
+   moves counts the proposals cycleOfMoves would have made: if a proposal would be accepted with chance p, the number it takes to get one accepted is drawn from the geometric distribution with that p.
+   Only the accepted moves take any time, so it is every CLOCK_EVERY of those that the clock is looked at. */
+struct cycleStats cycleOfMovesRejectionFree( struct chain *chain, double temp ) {
+	struct choices *choices = &chain->problem->choices;
+	struct supervisors *sups = &chain->problem->sups;
+	int cols = chain->problem->cols;
+	struct rateTree *tree = &chain->tree;
+	double budget = 1000.0 * cols;
+	double moves = 0;
+	double proposals = (double) cols * ( NUMPREFS - 1 ); /* how many different single moves cycleOfMoves picks from */
+	double accept, steps;
+	int successfulmoves = 0;
+	int slot, pair, k, oldProj, newProj;
+	struct cycleStats stats;
+
+	rateAll( chain, choices, temp );
+	while ( moves < budget && successfulmoves < 100 * cols ) {
+		if ( successfulmoves % CLOCK_EVERY == 0 && pastDeadline( chain ) ) {
+			break;
+		}
+		accept = tree->sum[1] / proposals; /* chance a proposal would be accepted */
+		if ( accept < 1e-12 ) { /* nothing can move - the allocation is frozen for this level */
+			moves = budget;
+			break;
+		}
+		steps = ( accept >= 1 ) ? 1 : 1 + floor( log( 1 - randUniform( &chain->rng ) ) / log1p( -accept ) );
+		moves += steps;
+		if ( moves > budget ) { /* the level would have ended before the move was found */
+			moves = budget;
+			break;
+		}
+		slot = pickMove( tree, randUniform( &chain->rng ) * tree->sum[1] );
+		pair = slot / NUMPREFS;
+		k = slot % NUMPREFS;
+		oldProj = chain->projNum[pair];
+		newProj = choices->prefProj[pair][k];
+		chain->currentEnergy += prefEnergy( chain->solver, k+1 ) - prefEnergy( chain->solver, chain->projPref[pair] );
+		movePair( chain, pair, newProj, k+1 );
+		successfulmoves++;
+		ratePair( chain, choices, pair, temp );
+		rateAround( chain, choices, sups, oldProj, temp );
+		rateAround( chain, choices, sups, newProj, temp );
+	}
+	stats.moves = (int) moves;
+	stats.accepted = successfulmoves;
+	stats.clash = 0;
+	stats.uphill = 0;
+	stats.lecturer = 0;
+	stats.same = 0;
+	chain->moves += stats.moves;
+	return stats;
+}
+
+/* The same checks as cycleOfMoves makes, worked out without making the move. RETURNS the chance it would be accepted */
+double moveRate( struct chain *chain, struct choices *choices, int pair, int k, double temp ) {
+	int proj = choices->prefProj[pair][k];
+	int oldProj = chain->projNum[pair];
+	float changeEnergy;
+
+	if ( proj < 0 || k+1 == chain->projPref[pair] ) { /* not a move */
+		return 0;
+	}
+	if ( chain->ledger.projOcc[proj] > 0 ) { /* clash */
+		return 0;
+	}
+	if ( supervisorsOver( chain, oldProj, proj ) ) { /* lecturer constraint */
+		return 0;
+	}
+	changeEnergy = prefEnergy( chain->solver, k+1 ) - prefEnergy( chain->solver, chain->projPref[pair] );
+	if ( changeEnergy <= 0 ) {
+		return 1;
+	}
+	if ( temp == 0 ) {
+		return 0;
+	}
+	return exp( -changeEnergy / temp );
+}
+
+void setRate( struct rateTree *tree, int slot, double rate ) {
+	int i = tree->leaves + slot;
+	tree->sum[i] = rate;
+	for ( i /= 2; i >= 1; i /= 2 ) { /* add up afresh rather than adding on the difference, so rounding errors do not build up */
+		tree->sum[i] = tree->sum[2*i] + tree->sum[2*i+1];
+	}
+}
+
+void ratePair( struct chain *chain, struct choices *choices, int pair, double temp ) {
+	int k;
+	for ( k = 0; k < NUMPREFS; k++ ) {
+		setRate( &chain->tree, pair * NUMPREFS + k, moveRate( chain, choices, pair, k, temp ) );
+	}
+}
+
+/* A pair has left or joined proj. That changes whether anyone else can move onto proj, and the loads of its supervisors, which changes whether anyone can move onto any of their projects. */
+void rateAround( struct chain *chain, struct choices *choices, struct supervisors *sups, int proj, double temp ) {
+	int i, j, c, lec, other;
+	for ( c = choices->chooserStart[proj]; c < choices->chooserStart[proj+1]; c++ ) {
+		ratePair( chain, choices, choices->chooser[c], temp );
+	}
+	for ( i = sups->projStart[proj]; i < sups->projStart[proj+1]; i++ ) {
+		lec = sups->lec[i];
+		for ( j = sups->lecStart[lec]; j < sups->lecStart[lec+1]; j++ ) {
+			other = sups->proj[j];
+			if ( other == proj ) {
+				continue;
+			}
+			for ( c = choices->chooserStart[other]; c < choices->chooserStart[other+1]; c++ ) {
+				ratePair( chain, choices, choices->chooser[c], temp );
+			}
+		}
+	}
+}
+
+void rateAll( struct chain *chain, struct choices *choices, double temp ) {
+	struct rateTree *tree = &chain->tree;
+	int pair, k, i;
+	for ( i = 0; i < tree->leaves; i++ ) {
+		tree->sum[tree->leaves + i] = 0;
+	}
+	for ( pair = 0; pair < chain->problem->cols; pair++ ) {
+		for ( k = 0; k < NUMPREFS; k++ ) {
+			tree->sum[tree->leaves + pair * NUMPREFS + k] = moveRate( chain, choices, pair, k, temp );
+		}
+	}
+	for ( i = tree->leaves - 1; i >= 1; i-- ) {
+		tree->sum[i] = tree->sum[2*i] + tree->sum[2*i+1];
+	}
+}
+
+/* Walks down from the top, going left if r is within the left hand total and right (less that total) if not. RETURNS the move (pair*NUMPREFS + k) */
+int pickMove( struct rateTree *tree, double r ) {
+	int i = 1;
+	while ( i < tree->leaves ) {
+		if ( r < tree->sum[2*i] || tree->sum[2*i+1] == 0 ) { /* rounding can leave r just past the last move with a rate, so never go right into nothing */
+			i = 2*i;
+		} else {
+			r -= tree->sum[2*i];
+			i = 2*i + 1;
+		}
+	}
+	return i - tree->leaves;
+}
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include "spa.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+/************************************************************************************************************/
+/*  Philox4x32-10, a counter-based random number generator (Salmon et al., "Parallel random numbers: as     */
+/*  easy as 1, 2, 3", SC11), as the other generator a randStream can have.                                  */
+/*    There is no state to speak of: the n-th block of 4 numbers of a stream is a fixed function of the     */
+/*    key (the seed), the stream number and n, 10 rounds of multiplies and XORs that scramble the counter.  */
+/*    So every chain of a run gets the same seed and its own stream number, and the streams are different   */
+/*    by construction rather than by hoping seed and seed+1 start far apart, any block can be had without   */
+/*    making the ones before it, and saving a stream is saving two numbers.                                 */
+/*    Blocks do not depend on each other either, so philoxFill makes 4 (SSE2) or 8 (AVX2) of them at once,  */
+/*    one in each lane, which gives exactly the same numbers as making them one at a time.                  */
+/*    spaTestGenerators is a quick statistical check of both generators, for --rng-test.                    */
+/************************************************************************************************************/
+
+#define PHILOX_M0 0xD2511F53u /* the round multipliers and key increments from the paper */
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+void philoxBlock( const unsigned int key[2], unsigned long long block, unsigned long long stream, unsigned int out[4] ); /* one block of 4 numbers, the slow way */
+void philoxFillWith( struct philox *gen, int path, int count, int out[] ); /* philoxFill with the KERNEL_SCALAR, KERNEL_SSE or KERNEL_AVX2 code */
+void philoxFillScalar( struct philox *gen, int count, int out[] );
+#ifdef HAVE_X86
+int philoxFillSSE( struct philox *gen, int count, int out[] );
+int philoxFillAVX2( struct philox *gen, int count, int out[] );
+#endif
+int philoxKnownAnswers( int path ); /* 1 if the answers match the ones published with the paper, made by philoxBlock and by path */
+int philoxWrapAgrees( int path ); /* 1 if path gives the same numbers as KERNEL_SCALAR where the low word of the block number wraps round */
+void testGenerator( struct randStream *rng, struct randStream *other, long int count, double result[] ); /* the statistics --rng-test prints, for one generator */
+
+const char *rngNames[] = { "ranvec", "philox" }; /* by RNG_ */
+
+void initPhilox( struct philox *gen, long int seed, int stream ) {
+	gen->key[0] = (unsigned int) seed;
+	gen->key[1] = (unsigned int) ( (unsigned long long) seed >> 32 );
+	gen->stream = stream;
+	gen->block = 0;
+}
+
+/* Counter (c0,c1) is the block number and (c2,c3) the stream. */
+void philoxBlock( const unsigned int key[2], unsigned long long block, unsigned long long stream, unsigned int out[4] ) {
+	unsigned long long product0, product1;
+	unsigned int x0 = (unsigned int) block, x1 = (unsigned int) ( block >> 32 ), x2 = (unsigned int) stream, x3 = (unsigned int) ( stream >> 32 );
+	unsigned int k0 = key[0], k1 = key[1];
+	int r;
+	for ( r = 0; r < PHILOX_ROUNDS; r++ ) {
+		product0 = (unsigned long long) PHILOX_M0 * x0;
+		product1 = (unsigned long long) PHILOX_M1 * x2;
+		x0 = (unsigned int) ( product1 >> 32 ) ^ x1 ^ k0;
+		x1 = (unsigned int) product1;
+		x2 = (unsigned int) ( product0 >> 32 ) ^ x3 ^ k1;
+		x3 = (unsigned int) product0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	out[0] = x0;
+	out[1] = x1;
+	out[2] = x2;
+	out[3] = x3;
+}
+
+/* Fills out with count (a multiple of 4) 31 bit integers, the next blocks of the stream, with the widest code the CPU can run. All of them give the same numbers. */
+void philoxFill( struct philox *gen, int count, int out[] ) {
+#ifdef HAVE_X86
+	philoxFillWith( gen, __builtin_cpu_supports( "avx2" ) ? KERNEL_AVX2 : KERNEL_SSE, count, out );
+#else
+	philoxFillWith( gen, KERNEL_SCALAR, count, out );
+#endif
+}
+
+/* The SIMD code does what it can and philoxFillScalar the rest. path has to be one checkKernel says the CPU can run */
+void philoxFillWith( struct philox *gen, int path, int count, int out[] ) {
+	int done = 0;
+#ifdef HAVE_X86
+	if ( path == KERNEL_AVX2 ) {
+		done = philoxFillAVX2( gen, count, out );
+	} else if ( path == KERNEL_SSE ) {
+		done = philoxFillSSE( gen, count, out );
+	}
+#endif
+	philoxFillScalar( gen, count - done, out + done );
+}
+
+void philoxFillScalar( struct philox *gen, int count, int out[] ) {
+	unsigned int words[4];
+	int i, k;
+	for ( i = 0; i < count; i += 4 ) {
+		philoxBlock( gen->key, gen->block++, gen->stream, words );
+		for ( k = 0; k < 4; k++ ) {
+			out[i + k] = (int) ( words[k] >> 1 ); /* the top 31 bits, as ranvec.c gives */
+		}
+	}
+}
+
+#ifdef HAVE_X86
+/* 4 blocks at a time, one in each lane: x0 to x3 are the 4 words of the counter, turned into the 4 numbers by the rounds. SSE2 can only multiply the even lanes, so the odd ones
+   are shifted down and multiplied separately. Stops before the low word of the block number would wrap round in the middle of 4, and leaves the rest to philoxFillScalar.
+   RETURNS how many numbers it made */
+int philoxFillSSE( struct philox *gen, int count, int out[] ) {
+	__m128i m0 = _mm_set1_epi32( (int) PHILOX_M0 ), m1 = _mm_set1_epi32( (int) PHILOX_M1 ), w0 = _mm_set1_epi32( (int) PHILOX_W0 ), w1 = _mm_set1_epi32( (int) PHILOX_W1 );
+	__m128i even = _mm_set_epi32( 0, -1, 0, -1 ), lanes = _mm_set_epi32( 3, 2, 1, 0 );
+	__m128i x0, x1, x2, x3, k0, k1, even0, odd0, even1, odd1, t0, t1, t2, t3;
+	int i, r;
+	for ( i = 0; i + 16 <= count && (unsigned int) gen->block <= 0xffffffffu - 3; i += 16 ) {
+		x0 = _mm_add_epi32( _mm_set1_epi32( (int) gen->block ), lanes );
+		x1 = _mm_set1_epi32( (int) ( gen->block >> 32 ) );
+		x2 = _mm_set1_epi32( (int) gen->stream );
+		x3 = _mm_set1_epi32( (int) ( gen->stream >> 32 ) );
+		k0 = _mm_set1_epi32( (int) gen->key[0] );
+		k1 = _mm_set1_epi32( (int) gen->key[1] );
+		for ( r = 0; r < PHILOX_ROUNDS; r++ ) {
+			even0 = _mm_mul_epu32( x0, m0 );
+			odd0 = _mm_mul_epu32( _mm_srli_epi64( x0, 32 ), m0 );
+			even1 = _mm_mul_epu32( x2, m1 );
+			odd1 = _mm_mul_epu32( _mm_srli_epi64( x2, 32 ), m1 );
+			x0 = _mm_xor_si128( _mm_xor_si128( _mm_or_si128( _mm_srli_epi64( even1, 32 ), _mm_andnot_si128( even, odd1 ) ), x1 ), k0 ); /* high half of M1 * x2 */
+			x1 = _mm_or_si128( _mm_and_si128( even1, even ), _mm_slli_epi64( odd1, 32 ) ); /* low half */
+			t0 = _mm_xor_si128( _mm_xor_si128( _mm_or_si128( _mm_srli_epi64( even0, 32 ), _mm_andnot_si128( even, odd0 ) ), x3 ), k1 );
+			x3 = _mm_or_si128( _mm_and_si128( even0, even ), _mm_slli_epi64( odd0, 32 ) );
+			x2 = t0;
+			k0 = _mm_add_epi32( k0, w0 );
+			k1 = _mm_add_epi32( k1, w1 );
+		}
+		t0 = _mm_unpacklo_epi32( x0, x1 ); /* from a word of each block in a lane to a block in each lane */
+		t1 = _mm_unpackhi_epi32( x0, x1 );
+		t2 = _mm_unpacklo_epi32( x2, x3 );
+		t3 = _mm_unpackhi_epi32( x2, x3 );
+		_mm_storeu_si128( (__m128i *) ( out + i ), _mm_srli_epi32( _mm_unpacklo_epi64( t0, t2 ), 1 ) );
+		_mm_storeu_si128( (__m128i *) ( out + i + 4 ), _mm_srli_epi32( _mm_unpackhi_epi64( t0, t2 ), 1 ) );
+		_mm_storeu_si128( (__m128i *) ( out + i + 8 ), _mm_srli_epi32( _mm_unpacklo_epi64( t1, t3 ), 1 ) );
+		_mm_storeu_si128( (__m128i *) ( out + i + 12 ), _mm_srli_epi32( _mm_unpackhi_epi64( t1, t3 ), 1 ) );
+		gen->block += 4;
+	}
+	return i;
+}
+
+/* The same as philoxFillSSE, 8 blocks at a time, with AVX2's blends putting the two halves of the products back together. */
+__attribute__(( target( "avx2" ) ))
+int philoxFillAVX2( struct philox *gen, int count, int out[] ) {
+	__m256i m0 = _mm256_set1_epi32( (int) PHILOX_M0 ), m1 = _mm256_set1_epi32( (int) PHILOX_M1 ), w0 = _mm256_set1_epi32( (int) PHILOX_W0 ), w1 = _mm256_set1_epi32( (int) PHILOX_W1 );
+	__m256i lanes = _mm256_set_epi32( 7, 6, 5, 4, 3, 2, 1, 0 );
+	__m256i x0, x1, x2, x3, k0, k1, even0, odd0, even1, odd1, t0, t1, t2, t3, u0, u1, u2, u3;
+	int i, r;
+	for ( i = 0; i + 32 <= count && (unsigned int) gen->block <= 0xffffffffu - 7; i += 32 ) {
+		x0 = _mm256_add_epi32( _mm256_set1_epi32( (int) gen->block ), lanes );
+		x1 = _mm256_set1_epi32( (int) ( gen->block >> 32 ) );
+		x2 = _mm256_set1_epi32( (int) gen->stream );
+		x3 = _mm256_set1_epi32( (int) ( gen->stream >> 32 ) );
+		k0 = _mm256_set1_epi32( (int) gen->key[0] );
+		k1 = _mm256_set1_epi32( (int) gen->key[1] );
+		for ( r = 0; r < PHILOX_ROUNDS; r++ ) {
+			even0 = _mm256_mul_epu32( x0, m0 );
+			odd0 = _mm256_mul_epu32( _mm256_srli_epi64( x0, 32 ), m0 );
+			even1 = _mm256_mul_epu32( x2, m1 );
+			odd1 = _mm256_mul_epu32( _mm256_srli_epi64( x2, 32 ), m1 );
+			x0 = _mm256_xor_si256( _mm256_xor_si256( _mm256_blend_epi32( _mm256_srli_epi64( even1, 32 ), odd1, 0xaa ), x1 ), k0 );
+			x1 = _mm256_blend_epi32( even1, _mm256_slli_epi64( odd1, 32 ), 0xaa );
+			t0 = _mm256_xor_si256( _mm256_xor_si256( _mm256_blend_epi32( _mm256_srli_epi64( even0, 32 ), odd0, 0xaa ), x3 ), k1 );
+			x3 = _mm256_blend_epi32( even0, _mm256_slli_epi64( odd0, 32 ), 0xaa );
+			x2 = t0;
+			k0 = _mm256_add_epi32( k0, w0 );
+			k1 = _mm256_add_epi32( k1, w1 );
+		}
+		t0 = _mm256_unpacklo_epi32( x0, x1 ); /* as philoxFillSSE, in each half, then the halves put in order */
+		t1 = _mm256_unpackhi_epi32( x0, x1 );
+		t2 = _mm256_unpacklo_epi32( x2, x3 );
+		t3 = _mm256_unpackhi_epi32( x2, x3 );
+		u0 = _mm256_unpacklo_epi64( t0, t2 ); /* blocks 0 and 4 */
+		u1 = _mm256_unpackhi_epi64( t0, t2 ); /* 1 and 5 */
+		u2 = _mm256_unpacklo_epi64( t1, t3 ); /* 2 and 6 */
+		u3 = _mm256_unpackhi_epi64( t1, t3 ); /* 3 and 7 */
+		_mm256_storeu_si256( (__m256i *) ( out + i ), _mm256_srli_epi32( _mm256_permute2x128_si256( u0, u1, 0x20 ), 1 ) );
+		_mm256_storeu_si256( (__m256i *) ( out + i + 8 ), _mm256_srli_epi32( _mm256_permute2x128_si256( u2, u3, 0x20 ), 1 ) );
+		_mm256_storeu_si256( (__m256i *) ( out + i + 16 ), _mm256_srli_epi32( _mm256_permute2x128_si256( u0, u1, 0x31 ), 1 ) );
+		_mm256_storeu_si256( (__m256i *) ( out + i + 24 ), _mm256_srli_epi32( _mm256_permute2x128_si256( u2, u3, 0x31 ), 1 ) );
+		gen->block += 8;
+	}
+	_mm256_zeroupper(); /* as in priceMovesAVX2 */
+	return i;
+}
+#endif
+
+/* The three test vectors in the Random123 distribution. path makes 8 blocks starting at a multiple of 8, so the one with the answer is made by the SIMD code along
+   with the others (which has to make all of them for that to be so), and its numbers are the top 31 bits of the answer. */
+int philoxKnownAnswers( int path ) {
+	static const unsigned int key[3][2] = { { 0, 0 }, { 0xffffffffu, 0xffffffffu }, { 0xa4093822u, 0x299f31d0u } };
+	static const unsigned long long block[3] = { 0, 0xffffffffffffffffULL, 0x85a308d3243f6a88ULL };
+	static const unsigned long long stream[3] = { 0, 0xffffffffffffffffULL, 0x0370734413198a2eULL };
+	static const unsigned int answer[3][4] = { { 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u },
+		{ 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu }, { 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u } };
+	struct philox gen;
+	unsigned int out[4];
+	int numbers[32];
+	int t, k, at;
+	for ( t = 0; t < 3; t++ ) {
+		philoxBlock( key[t], block[t], stream[t], out );
+		gen.key[0] = key[t][0];
+		gen.key[1] = key[t][1];
+		gen.stream = stream[t];
+		gen.block = block[t] & ~7ULL;
+		at = 4 * (int) ( block[t] & 7 );
+		philoxFillWith( &gen, path, 32, numbers );
+		for ( k = 0; k < 4; k++ ) {
+			if ( out[k] != answer[t][k] || numbers[at + k] != (int) ( answer[t][k] >> 1 ) ) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/* Starting from every one of the 8 blocks before the low word of the block number wraps round, fills 3 lots of 40 numbers with path, each lot doing what it can with
+   the SIMD code and the rest one block at a time as philoxFill does, and then the same again with KERNEL_SCALAR. */
+int philoxWrapAgrees( int path ) {
+	struct philox gen, scalar;
+	int numbers[120], expected[120];
+	int start, i;
+	for ( start = 1; start <= 8; start++ ) {
+		initPhilox( &gen, 0x123456789abcdefL, 5 );
+		gen.block = 0x2ffffffffULL - start + 1; /* start blocks before block number 0x300000000 */
+		scalar = gen;
+		for ( i = 0; i < 120; i += 40 ) {
+			philoxFillWith( &gen, path, 40, numbers + i );
+			philoxFillWith( &scalar, KERNEL_SCALAR, 40, expected + i );
+		}
+		for ( i = 0; i < 120; i++ ) {
+			if ( numbers[i] != expected[i] ) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+#define TEST_BINS 256 /* chi-squared of the top 8 bits */
+#define TEST_RANGE 7 /* and of randInt( 7 ), which has to throw some away */
+#define TEST_RESULTS 6
+
+/* result is: mean of randUniform, chi-squared of its top 8 bits (255 degrees of freedom), correlation of each number with the next, chi-squared of randInt( TEST_RANGE ) (6 degrees of freedom),
+   correlation with the same draw of other, and nanoseconds to make a number in bulk */
+void testGenerator( struct randStream *rng, struct randStream *other, long int count, double result[] ) {
+	long int bins[TEST_BINS] = { 0 }, ranges[TEST_RANGE] = { 0 };
+	double sum = 0, lagged = 0, crossed = 0, chi = 0, expected;
+	double u, v, previous = 0.5;
+	struct timespec start, end;
+	long int i, refills;
+	int k;
+
+	for ( i = 0; i < count; i++ ) {
+		u = randUniform( rng );
+		sum += u;
+		lagged += ( u - 0.5 ) * ( previous - 0.5 );
+		previous = u;
+		bins[(int) ( u * TEST_BINS )]++;
+		v = randUniform( other );
+		crossed += ( u - 0.5 ) * ( v - 0.5 );
+	}
+	for ( i = 0; i < count; i++ ) {
+		ranges[randInt( rng, TEST_RANGE )]++;
+	}
+	refills = count / RAND_BUFFER + 1;
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for ( i = 0; i < refills; i++ ) {
+		refillRandStream( rng );
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	result[0] = sum / count;
+	expected = (double) count / TEST_BINS;
+	for ( k = 0; k < TEST_BINS; k++ ) {
+		chi += ( bins[k] - expected ) * ( bins[k] - expected ) / expected;
+	}
+	result[1] = chi;
+	result[2] = lagged / ( count / 12.0 ); /* a uniform has variance 1/12 */
+	chi = 0;
+	expected = (double) count / TEST_RANGE;
+	for ( k = 0; k < TEST_RANGE; k++ ) {
+		chi += ( ranges[k] - expected ) * ( ranges[k] - expected ) / expected;
+	}
+	result[3] = chi;
+	result[4] = crossed / ( count / 12.0 );
+	result[5] = ( ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec ) ) / ( (double) refills * RAND_BUFFER );
+}
+
+/* Draws count numbers from two streams of each generator, as two chains of a run would have them (ranvec.c seeded seed and seed+1, Philox streams 0 and 1 of seed), and
+   prints how far each statistic is from what it should be. Each is turned into a rough number of standard deviations, and anything past 4 fails. RETURNS 0 if nothing failed, else -1 */
+int spaTestGenerators( long int seed, long int count, FILE *out ) {
+	static const char *names[TEST_RESULTS] = { "mean", "chi-squared, 256 bins", "serial correlation", "chi-squared, randInt(7)", "correlation between streams", "ns to make a number" };
+	struct randStream rng[2][2];
+	struct arena arena;
+	double result[RNG_KINDS][TEST_RESULTS], sigma[RNG_KINDS][TEST_RESULTS];
+	int failed = 0;
+	int g, k;
+
+	arena.size = 4 * ARENA_ROUND( RAND_BUFFER * sizeof(int) );
+	arena.base = malloc( arena.size );
+	arena.used = 0;
+	if ( arena.base == NULL || count < 1000 ) {
+		free( arena.base );
+		fprintf(out, "Need room for the buffers and a count of 1000 or more\n");
+		return -1;
+	}
+	for ( g = 0; g < RNG_KINDS; g++ ) {
+		initRandStream( &rng[g][0], g, seed, 0, &arena );
+		initRandStream( &rng[g][1], g, seed, 1, &arena );
+		testGenerator( &rng[g][0], &rng[g][1], count, result[g] );
+		freeRandStream( &rng[g][0] );
+		freeRandStream( &rng[g][1] );
+		sigma[g][0] = ( result[g][0] - 0.5 ) / sqrt( 1.0 / ( 12.0 * count ) );
+		sigma[g][1] = ( result[g][1] - ( TEST_BINS - 1 ) ) / sqrt( 2.0 * ( TEST_BINS - 1 ) );
+		sigma[g][2] = result[g][2] * sqrt( (double) count );
+		sigma[g][3] = ( result[g][3] - ( TEST_RANGE - 1 ) ) / sqrt( 2.0 * ( TEST_RANGE - 1 ) );
+		sigma[g][4] = result[g][4] * sqrt( (double) count );
+	}
+	free( arena.base );
+
+	fprintf(out, "%ld numbers from each of two streams, seed %ld\n", count, seed);
+	fprintf(out, "%-28s %22s %22s\n", "", rngNames[RNG_RANVEC], rngNames[RNG_PHILOX]);
+	for ( k = 0; k < TEST_RESULTS; k++ ) {
+		fprintf(out, "%-28s", names[k]);
+		for ( g = 0; g < RNG_KINDS; g++ ) {
+			if ( k == TEST_RESULTS - 1 ) {
+				fprintf(out, " %22.2f", result[g][k]);
+			} else {
+				fprintf(out, " %12.6g (%5.2f sd)%s", result[g][k], sigma[g][k], fabs( sigma[g][k] ) > 4 ? "!" : " ");
+				failed |= fabs( sigma[g][k] ) > 4;
+			}
+		}
+		fprintf(out, "\n");
+	}
+	for ( k = KERNEL_SCALAR; k <= KERNEL_AVX2; k++ ) { /* every way philoxFill can make the numbers that this CPU can run */
+		if ( checkKernel( k ) < 0 ) {
+			continue;
+		}
+		if ( !philoxKnownAnswers( k ) ) {
+			fprintf(out, "Philox does not give the published answers with the %s code\n", kernelNames[k]);
+			failed = 1;
+		}
+		if ( !philoxWrapAgrees( k ) ) {
+			fprintf(out, "Philox gives different numbers with the %s code from the scalar code where the block number wraps\n", kernelNames[k]);
+			failed = 1;
+		}
+	}
+	fprintf(out, "%s\n", failed ? "FAILED" : "All passed");
+	return failed ? -1 : 0;
+}
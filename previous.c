@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  Re-solving from a previous allocation, after a few pairs or supervisors have changed their minds.       */
+/*    The allocation is read back from a finalConfig.txt (pair, project, preference). There is no copy of   */
+/*    the old files, so what changed is worked out from the allocation itself: a pair whose project is no   */
+/*    longer one of its choices has changed them, a pair whose project is still a choice but with another   */
+/*    preference has re-ranked them, and a supervisor with too much work has had their workloads changed.   */
+/*    Every pair that can keep its project does. Pairs who changed their choices, new pairs and, starting   */
+/*    with the worst off, just enough of the pairs of supervisors with too much work are taken off their    */
+/*    projects, and then put back one at a time on the best of their choices that is free and that their    */
+/*    supervisors have room for. If there is none, a pair already on one of their choices is moved to       */
+/*    another of its own to make room. Only if that fails too does the usual search for a starting         */
+/*    configuration take over, which can move anyone.                                                       */
+/*    The annealing that follows starts cold (see previousTemp in libspa.h), so nearly the only moves made  */
+/*    are ones that lower the energy, and everyone else stays where they were.                             */
+/************************************************************************************************************/
+
+int rankOf( struct choices *choices, int pair, int proj ); /* the preference pair gave proj, or 0 if none */
+int fits( struct supervisors *sups, struct ledger *ledger, int proj ); /* 1 if proj is free and its supervisors have room for it */
+void seat( struct chain *chain, struct supervisors *sups, int pair, int proj, int pref ); /* puts a pair with no project on proj */
+void unseat( struct chain *chain, struct supervisors *sups, int pair ); /* takes a pair off its project */
+int seatBest( struct chain *chain, struct choices *choices, struct supervisors *sups, int pair, int notProj ); /* seats pair on its best choice that fits, other than notProj. RETURNS 1 if there was one */
+int makeRoom( struct chain *chain, struct choices *choices, struct supervisors *sups, int pair ); /* seats pair by moving someone else on to another of their choices. RETURNS 1 if it could */
+
+/* Adds up what readPrevious needs off the arena, in the same way as chainBytes. */
+size_t previousBytes( struct problem *problem ) {
+	return 2 * ARENA_ROUND( problem->cols * sizeof(int) );
+}
+
+/* Reads an allocation written by spaWriteAllocation into prevProj (from 0, or -1 for a pair it does not have) and prevPref. finalConfig.txt is added on to by every run, each allocation ending with its energy, so only the last one counts.
+   RETURNS 0, or -1 with the error written */
+int readPrevious( char *fileName, struct problem *problem, int prevProj[], int prevPref[], char error[ERROR_LENGTH] ) {
+	int cols = problem->cols;
+	FILE *file;
+	char line[256];
+	int pair, proj, pref, lineNumber = 0, found = 0, i;
+	int fresh = 1; /* 1 if the next pair starts another allocation */
+
+	file = fopen( fileName, "r" );
+	if ( file == NULL ) {
+		snprintf( error, ERROR_LENGTH, "Could not open %s", fileName );
+		return -1;
+	}
+	while ( fgets( line, sizeof(line), file ) != NULL ) {
+		lineNumber++;
+		if ( strncmp( line, "Final energy", 12 ) == 0 ) {
+			fresh = 1;
+			continue;
+		}
+		if ( sscanf( line, "%d,%d,%d", &pair, &proj, &pref ) != 3 || pair < 1 || proj < 1 ) {
+			snprintf( error, ERROR_LENGTH, "%s line %d: expected pair,project,preference", fileName, lineNumber );
+			fclose( file );
+			return -1;
+		}
+		if ( fresh ) {
+			for ( i = 0; i < cols; i++ ) {
+				prevProj[i] = -1;
+				prevPref[i] = 0;
+			}
+			found = 0;
+			fresh = 0;
+		}
+		if ( pair <= cols ) { /* pairs past the end have gone from the choices file */
+			prevProj[pair-1] = proj - 1;
+			prevPref[pair-1] = pref;
+			found++;
+		}
+	}
+	fclose( file );
+	if ( found == 0 ) {
+		snprintf( error, ERROR_LENGTH, "%s has no allocation for any of the %d pairs", fileName, cols );
+		return -1;
+	}
+	return 0;
+}
+
+/* Puts the chain as close to the previous allocation as the constraints now allow, printing what had changed. The ledger is left up to date.
+   RETURNS 0, or -1 if pairs had to be fitted in by repairConfiguration and it gave up */
+int keepPrevious( struct chain *chain, int prevProj[], int prevPref[] ) {
+	struct choices *choices = &chain->problem->choices;
+	struct supervisors *sups = &chain->problem->sups;
+	int rows = chain->problem->rows, cols = chain->problem->cols, numLec = chain->problem->numLec;
+	struct ledger *ledger = &chain->ledger;
+	int pair, pref, lec, i, worst, j;
+	int changed = 0, reranked = 0, added = 0, overloaded = 0, unplaced = 0;
+
+	for ( i = 0; i < rows; i++ ) {
+		ledger->projOcc[i] = 0;
+	}
+	for ( i = 0; i < numLec; i++ ) {
+		ledger->lecLoad[i] = 0;
+	}
+	ledger->clashCount = 0;
+	ledger->lecOver = 0;
+
+	/* everyone who still chose their project keeps it, for now */
+	for ( pair = 0; pair < cols; pair++ ) {
+		chain->projNum[pair] = -1;
+		if ( prevProj[pair] < 0 ) {
+			added++;
+			continue;
+		}
+		pref = ( prevProj[pair] < rows ) ? rankOf( choices, pair, prevProj[pair] ) : 0;
+		if ( pref == 0 || ledger->projOcc[prevProj[pair]] > 0 ) {
+			changed++;
+			continue;
+		}
+		if ( pref != prevPref[pair] ) {
+			reranked++;
+		}
+		seat( chain, sups, pair, prevProj[pair], pref );
+	}
+
+	/* take pairs off supervisors with too much work, the worst off first as they lose least */
+	for ( lec = 0; lec < numLec; lec++ ) {
+		while ( ledger->lecLoad[lec] > 1 + LOAD_TOLERANCE ) {
+			worst = -1;
+			for ( j = sups->lecStart[lec]; j < sups->lecStart[lec+1]; j++ ) {
+				for ( i = choices->chooserStart[sups->proj[j]]; i < choices->chooserStart[sups->proj[j]+1]; i++ ) {
+					pair = choices->chooser[i];
+					if ( chain->projNum[pair] == sups->proj[j] && ( worst < 0 || chain->projPref[pair] > chain->projPref[worst] ) ) {
+						worst = pair;
+					}
+				}
+			}
+			unseat( chain, sups, worst );
+			overloaded++;
+		}
+	}
+
+	/* and put everyone without a project back */
+	for ( pair = 0; pair < cols; pair++ ) {
+		if ( chain->projNum[pair] < 0 && !seatBest( chain, choices, sups, pair, -1 ) && !makeRoom( chain, choices, sups, pair ) ) {
+			for ( pref = 0; choices->prefProj[pair][pref] < 0; pref++ ); /* anywhere will do, the search puts it right */
+			seat( chain, sups, pair, choices->prefProj[pair][pref], pref + 1 );
+			unplaced++;
+		}
+	}
+	rebuildLedger( chain );
+
+	report( chain->solver, "Previous allocation: %d pairs changed their choices, %d re-ranked them, %d are new and %d were moved off supervisors with too much work\n", changed, reranked, added, overloaded);
+	if ( unplaced > 0 ) {
+		report( chain->solver, "%d pairs could not be fitted in without moving others, so searching for a starting configuration\n", unplaced);
+		return repairConfiguration( chain );
+	}
+	return 0;
+}
+
+/* Prints every pair whose project is not the one in the previous allocation. RETURNS how many */
+int reportChanges( struct chain *chain, int prevProj[], int prevPref[] ) {
+	int cols = chain->problem->cols;
+	int pair, moved = 0;
+	for ( pair = 0; pair < cols; pair++ ) {
+		if ( chain->projNum[pair] == prevProj[pair] ) {
+			continue;
+		}
+		if ( prevProj[pair] < 0 ) {
+			report( chain->solver, "Pair %d: new, given project %d (preference %d)\n", pair+1, chain->projNum[pair]+1, chain->projPref[pair]);
+		} else {
+			report( chain->solver, "Pair %d: project %d (preference %d) is now project %d (preference %d)\n", pair+1, prevProj[pair]+1, prevPref[pair], chain->projNum[pair]+1, chain->projPref[pair]);
+		}
+		moved++;
+	}
+	report( chain->solver, "%d of %d pairs have a different project from before\n", moved, cols);
+	return moved;
+}
+
+int rankOf( struct choices *choices, int pair, int proj ) {
+	int k;
+	for ( k = 0; k < NUMPREFS; k++ ) {
+		if ( choices->prefProj[pair][k] == proj ) {
+			return k + 1;
+		}
+	}
+	return 0;
+}
+
+int fits( struct supervisors *sups, struct ledger *ledger, int proj ) {
+	int k;
+	if ( ledger->projOcc[proj] > 0 ) {
+		return 0;
+	}
+	for ( k = sups->projStart[proj]; k < sups->projStart[proj+1]; k++ ) {
+		if ( ledger->lecLoad[sups->lec[k]] + sups->weight[k] > 1 + LOAD_TOLERANCE ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void seat( struct chain *chain, struct supervisors *sups, int pair, int proj, int pref ) {
+	chain->projNum[pair] = proj;
+	chain->projPref[pair] = pref;
+	chain->ledger.projOcc[proj]++;
+	changeLoad( sups, &chain->ledger, proj, 1 );
+}
+
+void unseat( struct chain *chain, struct supervisors *sups, int pair ) {
+	chain->ledger.projOcc[chain->projNum[pair]]--;
+	changeLoad( sups, &chain->ledger, chain->projNum[pair], -1 );
+	chain->projNum[pair] = -1;
+}
+
+int seatBest( struct chain *chain, struct choices *choices, struct supervisors *sups, int pair, int notProj ) {
+	int k, proj;
+	for ( k = 0; k < NUMPREFS; k++ ) {
+		proj = choices->prefProj[pair][k];
+		if ( proj >= 0 && proj != notProj && fits( sups, &chain->ledger, proj ) ) {
+			seat( chain, sups, pair, proj, k + 1 );
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Tries each of pair's choices in turn: the pair on it makes way, and pair takes it if that pair has somewhere else to go. */
+int makeRoom( struct chain *chain, struct choices *choices, struct supervisors *sups, int pair ) {
+	int k, proj, other, otherPref, c;
+	for ( k = 0; k < NUMPREFS; k++ ) {
+		proj = choices->prefProj[pair][k];
+		if ( proj < 0 || chain->ledger.projOcc[proj] == 0 ) { /* a free project that did not fit is no better now */
+			continue;
+		}
+		for ( c = choices->chooserStart[proj]; chain->projNum[choices->chooser[c]] != proj; c++ );
+		other = choices->chooser[c];
+		otherPref = chain->projPref[other];
+		unseat( chain, sups, other );
+		seat( chain, sups, pair, proj, k + 1 );
+		if ( seatBest( chain, choices, sups, other, proj ) ) {
+			return 1;
+		}
+		unseat( chain, sups, pair );
+		seat( chain, sups, other, proj, otherPref );
+	}
+	return 0;
+}
@@ -67,6 +67,15 @@
 /*   The current "state" of the generator is "coded" in the first */
 /*   BIGMAGICX elements of rand_w_arrayX.                         */
 /*                                                                */
+/* - Or invoke vector_random_generator_int(nrand, random_ints)    */
+/*   to get the un-normalized 31 bit integers instead.            */
+/*                                                                */
+/* - Every function also comes in a reentrant "_r" version that   */
+/*   takes a struct ranvec_state (see ranvec.h) holding its own   */
+/*   working arrays, so several independent generators can run    */
+/*   at once, e.g. one per thread. The plain versions share one   */
+/*   generator across the whole program.                          */
+/*                                                                */
 /* - There are also routines provided to save this status to a    */
 /*   file, and read it from there. Have care: In case you read    */
 /*   the status, make sure to first run the function              */
@@ -78,6 +87,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include "ranvec.h"
 
 #define BIGMAGIC1 250                       /* magic numbers for the      */
 #define SMALLMAGIC1 103                     /*   first generator          */
@@ -91,16 +101,20 @@
 #define NWARM 10000                         /* number of empty runs, c.g. */
 #define WORKFILE "ran250.dat"               /* to store the status        */
 
-/* The working arrays are declared as static so they need not be passed */
-/* to the main program */
+/* The working arrays of the plain versions are declared as static so  */
+/* they need not be passed to the main program */
 
-static int *rand_w_array1 = NULL;
-static int *rand_w_array2 = NULL;
+static struct ranvec_state default_state = { NULL, NULL };
 
 void init_vector_random_generator(int iseed,int nrand)
 {
-  extern int *rand_w_array1;
-  extern int *rand_w_array2;
+  init_vector_random_generator_r(&default_state,iseed,nrand);
+}
+
+void init_vector_random_generator_r(struct ranvec_state *state,int iseed,int nrand)
+{
+  int *rand_w_array1;
+  int *rand_w_array2;
   double rmod;
   int i, ihlp, imask1, imask2;
   int icyc, ncyc, nrest, ibas1, ibas2, ibas3;
@@ -132,8 +146,12 @@ void init_vector_random_generator(int iseed,int nrand)
 
 /* Allocate memory for the working arrays */
 
+  free(state->array1);
+  free(state->array2);
   rand_w_array1 = (int *) calloc(BIGMAGIC1 + nrand,sizeof(int));
   rand_w_array2 = (int *) calloc(BIGMAGIC2 + nrand,sizeof(int));
+  state->array1 = rand_w_array1;
+  state->array2 = rand_w_array2;
 
 /* Put congruential random numbers onto the working arrays */
 
@@ -261,10 +279,14 @@ void init_vector_random_generator(int iseed,int nrand)
   return;
 }
 
-void vector_random_generator(int nrand, double *random_numbers)
+/* Run both shift-register generators on by nrand steps.       */
+/* The new numbers are left in rand_w_arrayX, just after       */
+/* the first BIGMAGICX elements.                               */
+
+static void run_generators(struct ranvec_state *state,int nrand)
 {
-  extern int *rand_w_array1;
-  extern int *rand_w_array2;
+  int *rand_w_array1 = state->array1;
+  int *rand_w_array2 = state->array2;
   int i, icyc, ncyc, nrest, ibas1, ibas2, ibas3;
 
 /* First, run generator one */
@@ -347,6 +369,22 @@ void vector_random_generator(int nrand, double *random_numbers)
       rand_w_array2[i] = rand_w_array2[nrand + i];
     }
 
+  return;
+}
+
+void vector_random_generator(int nrand, double *random_numbers)
+{
+  vector_random_generator_r(&default_state,nrand,random_numbers);
+}
+
+void vector_random_generator_r(struct ranvec_state *state,int nrand, double *random_numbers)
+{
+  int *rand_w_array1 = state->array1;
+  int *rand_w_array2 = state->array2;
+  int i;
+
+  run_generators(state,nrand);
+
 /* Generate normalized random numbers:                        */
 /* Take output from generator one and combine it with         */
 /* that from generator two, via a simple XOR                  */
@@ -361,28 +399,76 @@ void vector_random_generator(int nrand, double *random_numbers)
   return;
 }
 
+/* Same as vector_random_generator, but gives the raw          */
+/* 31 bit integers in [0:BIGINTEGER] instead, so that          */
+/* integer draws can be made without any rounding.             */
+
+void vector_random_generator_int(int nrand, int *random_ints)
+{
+  vector_random_generator_int_r(&default_state,nrand,random_ints);
+}
+
+void vector_random_generator_int_r(struct ranvec_state *state,int nrand, int *random_ints)
+{
+  int *rand_w_array1 = state->array1;
+  int *rand_w_array2 = state->array2;
+  int i;
+
+  run_generators(state,nrand);
+
+#pragma ivdep
+  for(i = 0; i < nrand; ++i)
+    {
+      random_ints[i] = 
+	rand_w_array1[i + BIGMAGIC1] ^ rand_w_array2[i + BIGMAGIC2];
+    }
+
+  return;
+}
+
 void write_random_generator(void)
 {
-  extern int *rand_w_array1;
-  extern int *rand_w_array2;
   FILE *fp;
 
   fp = fopen(WORKFILE,"w");
-  fwrite(rand_w_array1,sizeof(int),BIGMAGIC1,fp);
-  fwrite(rand_w_array2,sizeof(int),BIGMAGIC2,fp);
+  write_random_generator_r(&default_state,fp);
   fclose(fp);
   return;
 }
 
 void read_random_generator(void)
 {
-  extern int *rand_w_array1;
-  extern int *rand_w_array2;
   FILE *fp;
 
   fp = fopen(WORKFILE,"r");
-  fread(rand_w_array1,sizeof(int),BIGMAGIC1,fp);
-  fread(rand_w_array2,sizeof(int),BIGMAGIC2,fp);
+  read_random_generator_r(&default_state,fp);
   fclose(fp);
   return;
 }
+
+/* The _r versions write to (read from) a file that is already    */
+/* open, so the status can go in a file along with other things.  */
+/* They return 0, or -1 if not everything could be written (read) */
+
+int write_random_generator_r(struct ranvec_state *state,FILE *fp)
+{
+  if(fwrite(state->array1,sizeof(int),BIGMAGIC1,fp) != BIGMAGIC1) return -1;
+  if(fwrite(state->array2,sizeof(int),BIGMAGIC2,fp) != BIGMAGIC2) return -1;
+  return 0;
+}
+
+int read_random_generator_r(struct ranvec_state *state,FILE *fp)
+{
+  if(fread(state->array1,sizeof(int),BIGMAGIC1,fp) != BIGMAGIC1) return -1;
+  if(fread(state->array2,sizeof(int),BIGMAGIC2,fp) != BIGMAGIC2) return -1;
+  return 0;
+}
+
+void free_random_generator_r(struct ranvec_state *state)
+{
+  free(state->array1);
+  free(state->array2);
+  state->array1 = NULL;
+  state->array2 = NULL;
+  return;
+}
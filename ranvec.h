@@ -0,0 +1,35 @@
+/******************************************************************/
+/*                                                                */
+/* Interface to the vectorized shift-register generator in        */
+/* ranvec.c. See there for how it works.                          */
+/*                                                                */
+/******************************************************************/
+
+#ifndef RANVEC_H
+#define RANVEC_H
+
+#include <stdio.h>
+
+/* The working arrays of one generator. Start from { NULL, NULL } */
+/* and call init_vector_random_generator_r before anything else.  */
+
+struct ranvec_state
+{
+  int *array1;
+  int *array2;
+};
+
+void init_vector_random_generator(int iseed,int nrand);
+void vector_random_generator(int nrand, double *random_numbers);
+void vector_random_generator_int(int nrand, int *random_ints);
+void write_random_generator(void);
+void read_random_generator(void);
+
+void init_vector_random_generator_r(struct ranvec_state *state,int iseed,int nrand);
+void vector_random_generator_r(struct ranvec_state *state,int nrand, double *random_numbers);
+void vector_random_generator_int_r(struct ranvec_state *state,int nrand, int *random_ints);
+int write_random_generator_r(struct ranvec_state *state,FILE *fp);
+int read_random_generator_r(struct ranvec_state *state,FILE *fp);
+void free_random_generator_r(struct ranvec_state *state);
+
+#endif
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  The library's front door: making problems and solvers, and solving one (see libspa.h for how they are   */
+/*  used). A problem is the two files read in, with its own arena, and is never written to once made. A     */
+/*  solver has a copy of the settings, the weights worked out from them, its own arena with the chain and   */
+/*  everything else the run needs, and its own clock. Nothing is kept anywhere else, so solvers on          */
+/*  different threads cannot get in each other's way.                                                       */
+/*  Nothing in here prints anything except through report, which goes to the solver's out, and what went    */
+/*  wrong with the files comes back in error rather than ending the program.                                */
+/************************************************************************************************************/
+
+/* The settings spa.out runs with when given no options. */
+void spaDefaults( struct settings *settings ) {
+	settings->seed = 0;
+	settings->generator = RNG_RANVEC;
+	/***THIS IS VERSION WITH 4.7, 4.15, 3, 2.3 (out of 5)**/
+	settings->score[0] = 4.7;
+	settings->score[1] = 4.15;
+	settings->score[2] = 3;
+	settings->score[3] = 2.35;
+	settings->schedule = SCHEDULE_LINEAR;
+	settings->startTemp = 5;
+	settings->endTemp = 0.001;
+	settings->coolStep = 0.001;
+	settings->cooling = 0.99;
+	settings->targetAccept = 0.02;
+	settings->frozenLevels = 0;
+	settings->rejectionFree = 0.01;
+	settings->moveMix[MOVE_SINGLE] = 1;
+	settings->moveMix[MOVE_SWAP] = 0;
+	settings->moveMix[MOVE_EJECT] = 0;
+	settings->kernel = KERNEL_AUTO;
+	settings->targetEnergy = NAN;
+	settings->timeLimit = 0;
+	settings->logEvery = 1;
+	settings->progressEvery = 100;
+	settings->checkpointEvery = 0;
+	settings->checkpointFile = "checkpoint.bin";
+	settings->resume = 0;
+	settings->boundIterations = 50;
+	settings->warmStart = 0;
+	settings->previousFile = NULL;
+	settings->previousTemp = 0.01;
+	settings->chains = 1;
+	settings->threads = 0;
+	settings->chainSummary = "chainSummary.txt";
+	settings->replicas = 0;
+	settings->rounds = 500;
+	settings->minTemp = 0.005;
+	settings->maxTemp = 5;
+	settings->driftCheck = 0;
+}
+
+/* Reads in both files and makes a problem of them. RETURNS the problem, or NULL with the error written */
+struct problem *spaLoadProblem( char *choicesName, char *supervisorsName, char error[ERROR_LENGTH] ) {
+	struct csvTable choicesFile, lecturersFile; /* the two files as they are read in */
+	struct problem *problem;
+
+	if ( loadCsv( choicesName, CSV_CHOICES, &choicesFile, error ) != 0 ) {
+		return NULL;
+	}
+	if ( loadCsv( supervisorsName, CSV_SUPERVISORS, &lecturersFile, error ) != 0 ) {
+		freeCsv( &choicesFile );
+		return NULL;
+	}
+	problem = makeProblem( &choicesFile, &lecturersFile, error );
+	freeCsv( &choicesFile );
+	freeCsv( &lecturersFile );
+	return problem;
+}
+
+/* The files give the size of the problem, so room for all of it is made in one go. The tables are left for the caller to free. RETURNS the problem, or NULL with the error written */
+struct problem *makeProblem( struct csvTable *choicesFile, struct csvTable *lecturersFile, char error[ERROR_LENGTH] ) {
+	struct problem *problem;
+
+	if ( lecturersFile->rows != choicesFile->rows ) {
+		snprintf( error, ERROR_LENGTH, "%s has %d projects but %s has %d", choicesFile->fileName, choicesFile->rows, lecturersFile->fileName, lecturersFile->rows );
+		return NULL;
+	}
+	problem = malloc( sizeof(struct problem) );
+	if ( problem == NULL ) {
+		snprintf( error, ERROR_LENGTH, "Out of memory" );
+		return NULL;
+	}
+	problem->rows = choicesFile->rows;
+	problem->cols = choicesFile->cells;
+	problem->numLec = lecturersFile->cells;
+	problem->arena.size = problemBytes( problem, lecturersFile->filled );
+	problem->arena.base = calloc( problem->arena.size, 1 ); /* zeroed, so the padding is the same every time it is compiled */
+	problem->arena.used = 0;
+	problem->mapping = NULL;
+	if ( problem->arena.base == NULL ) {
+		snprintf( error, ERROR_LENGTH, "Could not get %lu bytes of memory", (unsigned long) problem->arena.size );
+		free( problem );
+		return NULL;
+	}
+	allocChoices( problem );
+	allocSupervisors( problem, lecturersFile->filled );
+	if ( readChoices( choicesFile, problem, error ) != 0 ) {
+		spaFreeProblem( problem );
+		return NULL;
+	}
+	readLecturers( lecturersFile, problem );
+	return problem;
+}
+
+void spaProblemSize( struct problem *problem, int *projects, int *pairs, int *supervisors ) {
+	*projects = problem->rows;
+	*pairs = problem->cols;
+	*supervisors = problem->numLec;
+}
+
+void spaFreeProblem( struct problem *problem ) {
+	if ( problem->mapping != NULL ) {
+		munmap( problem->mapping, problem->mappedBytes );
+	} else {
+		free( problem->arena.base );
+	}
+	free( problem );
+}
+
+/* Makes a solver for problem, with everything it will need taken off its arena now. The settings are taken as they are: see main in Program.c for which make sense.
+   RETURNS the solver, or NULL with the error written */
+struct solver *spaNewSolver( struct problem *problem, struct settings *settings, FILE *out, char error[ERROR_LENGTH] ) {
+	struct solver *solver;
+	struct settings *s;
+
+	solver = malloc( sizeof(struct solver) );
+	if ( solver == NULL ) {
+		snprintf( error, ERROR_LENGTH, "Out of memory" );
+		return NULL;
+	}
+	solver->problem = problem;
+	solver->settings = *settings;
+	solver->out = out;
+	solver->lowerBound = -HUGE_VAL;
+	solver->relaxed = 0;
+	solver->prevProj = NULL;
+	solver->prevPref = NULL;
+	solver->seconds = 0;
+	solver->solved = 0;
+	solver->interrupted = 0;
+	solver->targetReached = 0;
+	startClock( solver );
+	s = &solver->settings;
+	if ( s->seed == 0 ) {
+		s->seed = (long int) time( NULL );
+	}
+	setWeights( solver );
+	solver->kernel = checkKernel( s->kernel );
+	if ( solver->kernel < 0 ) {
+		snprintf( error, ERROR_LENGTH, "This CPU cannot run the %s kernel", kernelNames[s->kernel] );
+		free( solver );
+		return NULL;
+	}
+	if ( s->previousFile != NULL && s->previousTemp > 0 ) {
+		s->startTemp = s->previousTemp * solver->weight[1];
+	}
+
+	solver->arena.size = chainBytes( problem ) + temperingBytes( problem, s->replicas ) + multiStartBytes( problem, s->chains, s->threads )
+		+ ( s->boundIterations > 0 || s->warmStart ? flowBytes( problem ) : 0 ) + ( s->previousFile != NULL ? previousBytes( problem ) : 0 );
+	solver->arena.base = malloc( solver->arena.size );
+	solver->arena.used = 0;
+	if ( solver->arena.base == NULL ) {
+		snprintf( error, ERROR_LENGTH, "Could not get %lu bytes of memory", (unsigned long) solver->arena.size );
+		free( solver );
+		return NULL;
+	}
+	allocChain( &solver->chain, solver, 0, &solver->arena );
+	if ( s->previousFile != NULL ) {
+		solver->prevProj = arenaAlloc( &solver->arena, problem->cols * sizeof(int) );
+		solver->prevPref = arenaAlloc( &solver->arena, problem->cols * sizeof(int) );
+		if ( readPrevious( s->previousFile, problem, solver->prevProj, solver->prevPref, error ) != 0 ) {
+			spaFreeSolver( solver );
+			return NULL;
+		}
+	}
+	return solver;
+}
+
+/* Anneals the solver's chain (or chains, or replicas) once, leaving the allocation in solver->chain. The telemetry goes to dataName.
+   RETURNS 0, or -1 with the error written */
+int spaSolve( struct solver *solver, char *dataName, char error[ERROR_LENGTH] ) {
+	struct settings *settings = &solver->settings;
+	struct problem *problem = solver->problem;
+	struct chain *chain = &solver->chain;
+	FILE *saveData = NULL;
+	int failed = 0; /* 1 if no starting configuration was found */
+
+	if ( solver->solved ) {
+		snprintf( error, ERROR_LENGTH, "This solver has already been run. Make another" );
+		return -1;
+	}
+	report( solver, "%d projects, %d pairs, %d supervisors\n", problem->rows, problem->cols, problem->numLec );
+	if ( solver->kernel != KERNEL_OFF && solver->kernel != KERNEL_AUTO && settings->moveMix[MOVE_SWAP] == 0 && settings->moveMix[MOVE_EJECT] == 0 ) {
+		report( solver, "Pricing moves in blocks of %d with the %s kernel\n", MOVE_BLOCK, kernelNames[solver->kernel] );
+	}
+
+	if ( settings->boundIterations > 0 || settings->warmStart ) { /* this leaves its best allocation in the chain, for a warm start */
+		solver->relaxed = relaxAllocation( solver, settings->boundIterations, &solver->arena, chain->projNum, chain->projPref, &solver->lowerBound );
+		if ( solver->relaxed < 0 ) {
+			snprintf( error, ERROR_LENGTH, "The pairs cannot all be given different projects they chose, so every allocation has a clash" );
+			return -1;
+		}
+		report( solver, "Lower bound on the energy %f", solver->lowerBound );
+		if ( solver->relaxed == 1 ) {
+			report( solver, ", and an allocation with energy %f found on the way", energy( solver, chain->projPref ) );
+		}
+		report( solver, "\n" );
+	}
+
+	solver->state.level = 0;
+	if ( settings->resume ) {
+		if ( readCheckpoint( settings->checkpointFile, chain, &solver->state, &settings->seed, &solver->earlierTime, error ) != 0 ) {
+			return -1;
+		}
+		if ( solver->state.schedule != settings->schedule ) {
+			snprintf( error, ERROR_LENGTH, "%s was made with a different schedule. Carry on with the same settings it was started with", settings->checkpointFile );
+			return -1;
+		}
+		rebuildLedger( chain );
+		if ( dataName != NULL ) {
+			truncate( dataName, solver->state.logBytes ); /* throw away any telemetry written after the checkpoint, as it will be written again */
+		}
+		report( solver, "Carrying on from %s: seed %ld, %d temperatures done, next temperature %f\n", settings->checkpointFile, settings->seed, solver->state.level, solver->state.temp );
+	}
+
+	if ( dataName != NULL ) {
+		saveData = fopen( dataName, settings->resume ? "a" : "w" ); /* a resumed run adds on to the telemetry it had already written */
+	}
+	if ( saveData != NULL ) {
+		setvbuf( saveData, solver->saveBuffer, _IOFBF, sizeof(solver->saveBuffer) );
+		if ( !settings->resume ) {
+			fprintf(saveData, "level,temp,energy,best,proposals,accepted,clash,uphill,lecturer,same,seconds\n");
+		}
+	}
+	if ( settings->replicas > 0 ) {
+		/* Parallel tempering. Each replica makes its own starting configuration, and the best one found comes back in the chain. */
+		failed = parallelTempering( solver, chain ) != 0;
+	} else if ( settings->chains > 1 ) {
+		/* Multi-start. Every chain is annealed on its own, and the best one comes back in the chain. */
+		failed = multiStart( solver, chain ) != 0;
+	} else {
+		if ( settings->previousFile != NULL ) {
+			failed = keepPrevious( chain, solver->prevProj, solver->prevPref ) != 0;
+			if ( !failed ) {
+				report( solver, "Starting from %s with energy %f\n", settings->previousFile, energy( solver, chain->projPref ) );
+			}
+		} else if ( !settings->resume && settings->warmStart ) {
+			if ( solver->relaxed == 0 ) { /* some lecturer has too much work, which the usual search puts right */
+				failed = repairConfiguration( chain ) != 0;
+			}
+			rebuildLedger( chain );
+		} else if ( !settings->resume ) {
+			failed = createInitialConfiguration( chain ) != 0;
+			/* We have a starting configuration WITH NO VIOLATIONS. */
+		}
+		if ( !failed ) {
+			anneal( chain, 1, saveData, &solver->state );
+			if ( ( settings->checkpointEvery > 0 || settings->resume ) && !solver->interrupted ) {
+				remove( settings->checkpointFile ); /* finished, so there is nothing to carry on from */
+			}
+		}
+	}
+	if ( failed ) { /* the search for a starting configuration gave up */
+		snprintf( error, ERROR_LENGTH, "No allocation within the supervisors' workloads was found%s", solver->interrupted ? " before the run was interrupted"
+			: settings->timeLimit > 0 && wallTime( solver ) >= settings->timeLimit ? " in the time allowed" : ". There may not be one: check they can take every pair between them" );
+		if ( saveData != NULL ) {
+			fclose( saveData );
+		}
+		return -1;
+	}
+
+	report( solver, "Final energy is %f\n", energy( solver, chain->projPref ) );
+	if ( solver->lowerBound > -HUGE_VAL ) {
+		report( solver, "Gap to the lower bound %f\n", energy( solver, chain->projPref ) - solver->lowerBound );
+	}
+	if ( settings->previousFile != NULL ) {
+		reportChanges( chain, solver->prevProj, solver->prevPref );
+	}
+	solver->seconds = wallTime( solver );
+	report( solver, "%ld moves in %.3f s, %.0f moves per second\n", chain->moves, solver->seconds, chain->moves / solver->seconds );
+	if ( !isnan( settings->targetEnergy ) && chain->targetTime >= 0 ) {
+		report( solver, "Reached energy %f after %.3f s\n", settings->targetEnergy, chain->targetTime );
+	} else if ( !isnan( settings->targetEnergy ) ) {
+		report( solver, "Did not reach energy %f\n", settings->targetEnergy );
+	}
+	if ( saveData != NULL ) {
+		fclose( saveData );
+	}
+	solver->solved = 1;
+	return 0;
+}
+
+/* Asks a running spaSolve to stop as soon as it can, which is at the end of the level (or round) each chain is on, and finish with the best allocation found so far.
+   Only sets a flag, so it can be called from a signal handler or another thread */
+void spaInterrupt( struct solver *solver ) {
+	solver->interrupted = 1;
+}
+
+/* How the run went. status is -1 until spaSolve has finished */
+void spaGetResult( struct solver *solver, struct result *result ) {
+	struct problem *problem = solver->problem;
+	result->status = solver->solved ? 0 : -1;
+	result->pairs = problem->cols;
+	result->projects = problem->rows;
+	result->supervisors = problem->numLec;
+	result->energy = energy( solver, solver->chain.projPref );
+	result->bound = solver->lowerBound;
+	result->moves = solver->chain.moves;
+	result->seconds = solver->seconds;
+}
+
+void spaGetAllocation( struct solver *solver, int projNum[], int projPref[] ) {
+	int i;
+	for ( i = 0; i < solver->problem->cols; i++ ) {
+		projNum[i] = solver->chain.projNum[i];
+		projPref[i] = solver->chain.projPref[i];
+	}
+}
+
+/* print final configuration to file. Each run adds on to the end, finishing with its energy. RETURNS 0, or -1 if it could not be written */
+int spaWriteAllocation( struct solver *solver, char *configName ) {
+	FILE *finalConfig; /* this file saves the final configuration - which pair have what project */
+	int i;
+	finalConfig = fopen(configName, "a");
+	if ( finalConfig == NULL ) {
+		return -1;
+	}
+	for (i=0; i<solver->problem->cols; i++) {
+		fprintf(finalConfig, "%d,%d,%d\n", i+1, solver->chain.projNum[i]+1, solver->chain.projPref[i]);
+	}
+	fprintf(finalConfig, "Final energy: %f\n", energy( solver, solver->chain.projPref ) );
+	return fclose(finalConfig) == 0 ? 0 : -1;
+}
+
+void spaFreeSolver( struct solver *solver ) {
+	freeChain( &solver->chain );
+	free( solver->arena.base );
+	free( solver );
+}
+
+void report( struct solver *solver, const char *format, ... ) {
+	va_list args;
+	if ( solver->out == NULL ) {
+		return;
+	}
+	va_start( args, format );
+	vfprintf( solver->out, format, args );
+	va_end( args );
+}
+
+/* Starts wallTime from 0 */
+void startClock( struct solver *solver ) {
+	clock_gettime( CLOCK_MONOTONIC, &solver->startTime );
+	solver->earlierTime = 0;
+}
+
+/* RETURNS the seconds since the solver was made, plus any the run took before it was resumed */
+double wallTime( struct solver *solver ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return solver->earlierTime + ( now.tv_sec - solver->startTime.tv_sec ) + 1e-9 * ( now.tv_nsec - solver->startTime.tv_nsec );
+}
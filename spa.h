@@ -0,0 +1,283 @@
+/************************************************************************************************************/
+/*  The inside of libspa, shared between solver.c (problems and solvers, and solving one), anneal.c (the    */
+/*  annealing), blockmoves.c (single moves priced in blocks), philox.c (the counter-based random numbers),  */
+/*  loader.c (reading in the files), instance.c (compiled instances), tempering.c (the parallel tempering), */
+/*  multistart.c (independent chains), nfold.c (rejection-free moves), checkpoint.c (saving a run to carry  */
+/*  on later), flow.c (the lower bound and warm start) and previous.c (re-solving from an earlier           */
+/*  allocation).                                                                                            */
+/*  Nothing here is global: the size of the problem and its data are in struct problem, and everything      */
+/*  else about a run is in struct solver, which every chain points back to.                                 */
+/*  Users of the library only see libspa.h.                                                                 */
+/************************************************************************************************************/
+
+#ifndef SPA_H
+#define SPA_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include "ranvec.h"
+#include "libspa.h"
+
+#define RAND_BUFFER 100000 /* how many random numbers the generator makes in one go. A multiple of 4, for Philox */
+#define RAND_RANGE 2147483648.0 /* both generators give integers from 0 up to (not including) this */
+#define LOAD_TOLERANCE 1e-6 /* lecturer loads are running sums, so allow for rounding when comparing them against unit workload */
+#define CSV_CHOICES 1 /* the two kinds of file loadCsv reads */
+#define CSV_SUPERVISORS 2
+#define MAX_MOVED 2 /* the most pairs one move shifts */
+#define CLOCK_EVERY 4096 /* how many proposals a level makes between looks at the clock, when the chain has a deadline */
+#define REPAIR_STALL 1000 /* repairConfiguration gives up after this many moves a pair in a row without fewer broken constraints */
+#define MOVE_BLOCK 256 /* how many single moves blockmoves.c draws in one go */
+#define BLOCK_SAME 0 /* what pricing found a move in a block would do */
+#define BLOCK_CLASH 1
+#define BLOCK_OPEN 2 /* the project is free, so it comes down to the energy and the supervisors */
+#define ARENA_ROUND( bytes ) ( ( (bytes) + 15 ) & ~(size_t) 15 ) /* arenaAlloc hands out memory in multiples of 16 bytes */
+
+/* The choices the pairs made, imported from the first file. Only the (at most NUMPREFS) ranked projects of each pair are kept, both ways round. */
+struct choices {
+	int (*prefProj)[NUMPREFS]; /* prefProj[pair][k] is the project the pair gave preference k+1, or -1 if they did not give that preference */
+	int *chooserStart; /* the pairs who chose project p are chooser[chooserStart[p]] to chooser[chooserStart[p+1]-1] */
+	int *chooser; /* pair number */
+	int *chooserPref; /* and the preference they gave p */
+};
+
+/* The supervisor constraints, imported from the second file. Most projects only have one or two supervisors, so only the filled in cells (links) are kept, both ways round. */
+struct supervisors {
+	int links; /* number of filled in cells, i.e. (project, lecturer) links */
+	int *projStart; /* the supervisors of project p are lec[projStart[p]] to lec[projStart[p+1]-1] */
+	int *lec;
+	float *weight; /* with how much work project p is for each of them */
+	int *lecStart; /* the projects of lecturer j are proj[lecStart[j]] to proj[lecStart[j+1]-1] */
+	int *proj;
+	float *projWeight; /* with how much work each is for j */
+};
+
+/* One block of heap memory that all of the state is carved out of. It is sized once at startup, when the size of the problem is known, so nothing lives on the stack or needs freeing one by one. */
+struct arena {
+	char *base;
+	size_t size;
+	size_t used;
+};
+
+/* One stream of the Philox generator: the seed, which stream it is and how far along it has got. That is all of it. See philox.c */
+struct philox {
+	unsigned int key[2];
+	unsigned long long stream;
+	unsigned long long block; /* the next block of 4 numbers */
+};
+
+/* A stream of random numbers. Its own generator is seeded once, then fills the buffer in bulk and we draw from it until it runs out. Streams do not share anything, so each thread can have one. */
+struct randStream {
+	int generator; /* RNG_RANVEC or RNG_PHILOX */
+	struct ranvec_state gen; /* the generator behind this stream, if ranvec.c */
+	struct philox philox; /* or if Philox */
+	int *buffer; /* RAND_BUFFER raw 31 bit integers */
+	int cursor; /* next one to use */
+};
+
+/* Running totals kept alongside the allocation (projNum and projPref) so a move can be checked without rescanning every pair. movePair keeps them up to date. */
+struct ledger {
+	int *projOcc; /* for each project, stores how many pairs are currently assigned to it */
+	int clashCount; /* number of clashing couples of pairs, i.e. what projClashFullCount used to count */
+	double *lecLoad; /* for each lecturer, the total weight of the projects they are currently supervising */
+	int lecOver; /* number of lecturers currently over unit workload */
+};
+
+/* A problem: its size, worked out from the files, and the choices and supervisors. Read only once made, so solvers on any number of threads can share it. */
+struct problem {
+	int rows; /* NUMBER OF PROJECTS */
+	int cols; /* NUMBER OF PAIRS (some might be singletons) */
+	int numLec; /* NUMBER OF LECTURERS */
+	struct choices choices;
+	struct supervisors sups;
+	struct arena arena; /* the choices and supervisors live in here */
+	void *mapping; /* the compiled instance the arena is in, or NULL if it was read from csv files */
+	size_t mappedBytes;
+};
+
+/* A csv file as loadCsv reads it: the filled in cells in the order they are in the file. */
+struct csvTable {
+	char *fileName;
+	int rows; /* rows of data in the file */
+	int cells; /* cells on every row, not counting a label column */
+	int label; /* 1 if the first column is a dummy column of labels, which is skipped */
+	int filled; /* how many cells are filled in */
+	int capacity; /* how many there is room for */
+	int *row; /* the row, column (not counting the label) and value of each filled in cell */
+	int *col;
+	float *value;
+};
+
+/* A move of up to MAX_MOVED pairs, with where each one was before so it can be undone. */
+struct move {
+	int moved; /* how many pairs moved. 0 if the move came to nothing */
+	int pair[MAX_MOVED]; /* in the order they moved */
+	int proj[MAX_MOVED]; /* the project each had before */
+	int pref[MAX_MOVED]; /* and its preference for it */
+};
+
+/* A block of single moves, priced together. One array for each thing about them, so they can be worked out several at a time. See blockmoves.c */
+struct moveBlock {
+	int *pair; /* the pair each moves */
+	int *skip; /* which of its other preferences it goes to, 0 to NUMPREFS-2 */
+	int *pref; /* and so the preference it goes to, 1 to NUMPREFS, as of when it was priced */
+	int *proj; /* the project of that preference, -1 if the pair did not give it */
+	int *verdict; /* BLOCK_SAME, BLOCK_CLASH or BLOCK_OPEN */
+	float *change; /* the change in energy it would make */
+};
+
+/* The chances of every single move being accepted, added up in a tree so one can be picked in proportion to its chance. See nfold.c */
+struct rateTree {
+	int leaves; /* a power of two, at least cols*NUMPREFS */
+	double *sum; /* 2*leaves of them */
+};
+
+/* One annealing chain: an allocation, the ledger kept alongside it, its running energy and its own random numbers.
+   Chains share nothing but the read only choices and supervisors, so each can run on its own thread. */
+struct chain {
+	struct problem *problem; /* what it is an allocation of */
+	struct solver *solver; /* the run it is part of, with the settings and weights */
+	int *projNum; /* for each pair, stores what number project they are currently assigned */
+	int *projPref; /* for each pair, stores what preference their currently assigned project is. NOTE the preference stored here is not zero-indexed. */
+	int *bestNum, *bestPref; /* the lowest energy allocation anneal has seen at the end of a level */
+	struct ledger ledger;
+	float currentEnergy; /* running energy of the allocation, kept up to date move by move */
+	struct randStream rng; /* where all the chain's random numbers come from */
+	struct move move; /* the last move made */
+	struct rateTree tree; /* for rejection-free moves */
+	struct moveBlock block; /* for moves priced in blocks */
+	int kernel; /* the KERNEL_ they are priced with. KERNEL_AUTO until the first block has been timed */
+	long int moves; /* proposals made so far, counting those rejection-free moves skip */
+	double targetTime; /* seconds into the run at which it first got down to targetEnergy, or -1 if it has not */
+	double deadline; /* seconds into the run by which anneal must be done, or 0 for no limit */
+};
+
+/* What one cycleOfMoves did, for the cooling schedule to go on and for the telemetry in newData.txt. */
+struct cycleStats {
+	int moves; /* proposals made */
+	int accepted; /* proposals kept */
+	int clash; /* rejected because two pairs would share a project */
+	int uphill; /* rejected on energy */
+	int lecturer; /* rejected because a supervisor would have too much work */
+	int same; /* came to nothing, e.g. the pair did not give the preference picked */
+};
+
+/* Where anneal has got to, between two temperatures. This, the chain and the random numbers are all it takes to carry on. */
+struct annealState {
+	int schedule; /* the cooling schedule being followed */
+	double temp; /* the next temperature to do */
+	int level; /* temperatures done. 0 if anneal has not started */
+	int stale; /* settled temperatures in a row without a new best */
+	int noRejections; /* 1 once switched to rejection-free moves */
+	float bestEnergy; /* the lowest energy so far */
+	struct cycleStats logged; /* added up since the last line of telemetry */
+	long int logBytes; /* how long newData.txt was */
+};
+
+/* One run on a problem. Everything that used to be a global is in here, so solvers have nothing in common but the problem. */
+struct solver {
+	struct problem *problem; /* shared, read only */
+	struct settings settings; /* a copy of the ones it was made with, so the caller can change theirs */
+	float weight[NUMPREFS + 1]; /* weight[pref] is the energy saved by a pair having its preference pref, worked out from the scores. weight[0] is 0 */
+	int kernel; /* the KERNEL_ single moves are priced with: settings.kernel, checked against the CPU */
+	FILE *out; /* where how the run is going is printed. NULL for nowhere */
+	struct arena arena; /* the chain and everything else the run needs */
+	struct chain chain; /* the allocation. With more than one chain or replica, the best one found ends up here */
+	struct annealState state; /* where the annealing has got to, for checkpoints */
+	double lowerBound; /* no allocation can have less energy than this */
+	int relaxed; /* what relaxAllocation found */
+	int *prevProj, *prevPref; /* the allocation in previousFile */
+	struct timespec startTime; /* when spaSolve started */
+	double earlierTime; /* seconds the run had taken before it was carried on with resume */
+	double seconds; /* how long spaSolve took */
+	int solved; /* 1 once spaSolve has finished */
+	volatile sig_atomic_t interrupted; /* set by spaInterrupt, maybe from a signal handler. Every chain stops at the end of its level */
+	volatile int targetReached; /* set once any chain gets down to targetEnergy, so the others stop too */
+	char saveBuffer[1 << 16]; /* the telemetry is written out from here in big blocks, not a line at a time */
+};
+
+/* solver.c */
+struct problem *makeProblem( struct csvTable *choicesFile, struct csvTable *lecturersFile, char error[ERROR_LENGTH] ); /* puts the two files as loadCsv read them into a new problem */
+void report( struct solver *solver, const char *format, ... ); /* printf to solver->out, if there is one */
+void startClock( struct solver *solver ); /* starts the run's clock from 0 */
+double wallTime( struct solver *solver ); /* seconds since the run started */
+
+/* anneal.c */
+void *arenaAlloc( struct arena *arena, size_t bytes ); /* takes the next bytes off the arena */
+size_t problemBytes( struct problem *problem, int links ); /* how much of the arena the choices and supervisors need */
+void allocChoices( struct problem *problem ); /* makes room for the choices */
+void allocSupervisors( struct problem *problem, int links ); /* makes room for the supervisors */
+void allocLedger( struct ledger *ledger, struct problem *problem, struct arena *arena ); /* makes room for the ledger */
+size_t chainBytes( struct problem *problem ); /* how much of the arena one chain needs */
+void allocChain( struct chain *chain, struct solver *solver, int stream, struct arena *arena ); /* makes room for a chain of solver's, with random numbers from stream (from 0) of its seed */
+void freeChain( struct chain *chain ); /* frees what allocChain took from outside the arena */
+void initRandStream( struct randStream *rng, int generator, long int seed, int stream, struct arena *arena ); /* seeds the stream's generator and fills the first buffer */
+void refillRandStream( struct randStream *rng ); /* makes a new buffer of numbers */
+void freeRandStream( struct randStream *rng ); /* frees the generator behind the stream */
+int randInt( struct randStream *rng, int n ); /* random integer in [0,n), every value equally likely */
+void randInts( struct randStream *rng, int n, int count, int out[] ); /* count of them, more quickly */
+double randUniform( struct randStream *rng ); /* random number in [0,1) */
+void setWeights( struct solver *solver ); /* works out the weights from the scores */
+void noteTarget( struct chain *chain, float bestEnergy ); /* records when the chain first gets down to targetEnergy */
+float energy( struct solver *solver, int projPref[] ); /* calculates energy of a given allocation */
+int pastDeadline( struct chain *chain ); /* 1 if the chain has a deadline and it has gone */
+float prefEnergy( struct solver *solver, int pref ); /* energy contribution of ONE pair holding a project of preference pref */
+void movePair( struct chain *chain, int pair, int proj, int pref ); /* moves ONE pair to a new project, keeping the ledger up to date */
+int createInitialConfiguration( struct chain *chain ); /* does what it says. RETURNS -1 if it could not */
+int repairConfiguration( struct chain *chain ); /* moves pairs about until no constraint is broken. RETURNS -1 if it gave up */
+void rebuildLedger( struct chain *chain ); /* works out the occupancy counts and lecturer loads from scratch */
+void changeLoad( struct supervisors *sups, struct ledger *ledger, int proj, int sign ); /* adds (sign 1) or takes away (sign -1) one pair on proj from its supervisors loads */
+int countViolations( struct ledger *ledger ); /* counts violations of constraints */
+int supervisorsOver( struct chain *chain, int oldProj, int proj ); /* 1 if moving a pair from oldProj to proj would give one of proj's supervisors too much work */
+struct cycleStats cycleOfMoves( struct chain *chain, double temp ); /* Does all the moves for a fixed temp.*/
+void anneal( struct chain *chain, int verbose, FILE *saveData, struct annealState *state ); /* cools a chain from its starting configuration, logging to saveData if it is not NULL. With state, carries on from it and saves checkpoints */
+
+/* tempering.c */
+size_t temperingBytes( struct problem *problem, int numReplicas ); /* how much of the arena parallelTempering needs */
+int parallelTempering( struct solver *solver, struct chain *best ); /* runs the replicas and leaves the best allocation found in best. RETURNS -1 if none had a starting configuration */
+
+/* nfold.c */
+size_t rateTreeBytes( struct problem *problem ); /* how much of the arena a rate tree needs */
+void allocRateTree( struct rateTree *tree, struct problem *problem, struct arena *arena ); /* makes room for a rate tree */
+struct cycleStats cycleOfMovesRejectionFree( struct chain *chain, double temp ); /* cycleOfMoves without the rejections */
+
+/* blockmoves.c */
+extern const char *kernelNames[]; /* what each KERNEL_ is called */
+size_t moveBlockBytes( void ); /* how much of the arena a block of moves needs */
+void allocMoveBlock( struct moveBlock *block, struct arena *arena ); /* makes room for a block of moves */
+int checkKernel( int kernel ); /* kernel, or -1 if the CPU cannot run it */
+struct cycleStats cycleOfMovesBlocked( struct chain *chain, double temp ); /* cycleOfMoves, with single moves priced in blocks */
+
+/* philox.c */
+extern const char *rngNames[]; /* what each RNG_ is called */
+void initPhilox( struct philox *gen, long int seed, int stream ); /* starts stream of seed from its first block */
+void philoxFill( struct philox *gen, int count, int out[] ); /* the next count (a multiple of 4) numbers */
+
+/* multistart.c */
+size_t multiStartBytes( struct problem *problem, int numChains, int numThreads ); /* how much of the arena multiStart needs */
+int multiStart( struct solver *solver, struct chain *best ); /* anneals the chains and leaves the best allocation in best. RETURNS -1 if none had a starting configuration */
+
+/* flow.c */
+size_t flowBytes( struct problem *problem ); /* how much of the arena relaxAllocation needs */
+int relaxAllocation( struct solver *solver, int iterations, struct arena *arena, int projNum[], int projPref[], double *bound ); /* a lower bound on the energy, and the best allocation found working it out */
+
+/* previous.c */
+size_t previousBytes( struct problem *problem ); /* how much of the arena the previous allocation needs */
+int readPrevious( char *fileName, struct problem *problem, int prevProj[], int prevPref[], char error[ERROR_LENGTH] ); /* reads an allocation back from a finalConfig.txt */
+int keepPrevious( struct chain *chain, int prevProj[], int prevPref[] ); /* starts the chain from it, changing as little as the constraints allow. RETURNS -1 if no starting configuration was found */
+int reportChanges( struct chain *chain, int prevProj[], int prevPref[] ); /* prints the pairs whose project has changed. RETURNS how many */
+
+/* checkpoint.c */
+int writeCheckpoint( char *fileName, struct chain *chain, struct annealState *state, long int seed ); /* saves everything needed to carry on, replacing fileName in one go */
+int readCheckpoint( char *fileName, struct chain *chain, struct annealState *state, long int *seed, double *elapsed, char error[ERROR_LENGTH] ); /* the other way round */
+
+/* loader.c */
+int loadCsv( char *fileName, int kind, struct csvTable *table, char *error ); /* reads one csv file into a table */
+void freeCsv( struct csvTable *table ); /* frees what loadCsv made */
+int readChoices( struct csvTable *table, struct problem *problem, char *error ); /* puts the choices file into the problem */
+void buildChoosers( struct problem *problem ); /* fills in the project -> pair side of the choices */
+void readLecturers( struct csvTable *table, struct problem *problem ); /* puts the supervisors file into the problem */
+void buildLecturerProjects( struct problem *problem, int *linkProj ); /* fills in the lecturer -> project side of the supervisors */
+
+#endif
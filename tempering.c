@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "spa.h"
+
+/************************************************************************************************************/
+/*  Parallel tempering (replica exchange).                                                                  */
+/*    Instead of one chain being cooled slowly, numReplicas chains run side by side, one thread each, at    */
+/*    fixed temperatures spaced geometrically from minTemp up to maxTemp. Every replica does one            */
+/*    cycleOfMoves at its temperature, then the threads wait for each other and neighbouring temperatures   */
+/*    try to swap configurations: replicas at temperatures Ti and Tj with energies Ei and Ej swap with      */
+/*    probability min(1, exp((1/Ti - 1/Tj)(Ei - Ej))). Good configurations found while hot drift down to    */
+/*    the cold end, and the cold end can escape a bad minimum by swapping up.                               */
+/*    Rather than copying configurations, the replicas swap temperatures, which comes to the same thing.    */
+/*    Even and odd neighbours take turns so every swap in a round is independent of the others.             */
+/************************************************************************************************************/
+
+/* One chain. Only the thread running it touches it, apart from the swaps between rounds. */
+struct replica {
+	struct chain chain; /* with its number as its random number stream, so no two replicas draw the same numbers */
+	int rung; /* which temperature it is at, 0 is the coldest */
+};
+
+/* Everything the threads share. */
+struct tempering {
+	struct solver *solver; /* the problem in it is read only */
+	int numReplicas;
+	int rounds;
+	struct replica *replicas;
+	double *ladder; /* ladder[k] is the temperature of rung k */
+	int *atRung; /* atRung[k] is the replica currently at rung k */
+	long int *swapsTried; /* swaps tried and made between rungs k and k+1 */
+	long int *swapsMade;
+	int *bestProjNum; /* the lowest energy allocation any replica has had at the end of a round */
+	int *bestProjPref;
+	float bestEnergy;
+	struct chain *best; /* where the best allocation goes at the end. Until then only its targetTime is used */
+	int stop; /* set by thread 0 between rounds once the time is up, the target energy has been reached or the run is interrupted */
+	int failed; /* set by any replica that finds no starting configuration, when none of them go on */
+	pthread_barrier_t barrier;
+};
+
+/* What one thread is given. */
+struct worker {
+	struct tempering *pt;
+	int id; /* the replica it runs */
+	pthread_t thread;
+};
+
+void *runReplica( void *arg ); /* the work of one thread */
+void swapRung( struct tempering *pt, int k, struct randStream *rng ); /* tries to swap the replicas at rungs k and k+1 */
+void keepBest( struct tempering *pt ); /* copies the lowest energy replica into best if it beats it */
+
+/* Adds up what parallelTempering takes off the arena, in the same way as chainBytes. */
+size_t temperingBytes( struct problem *problem, int numReplicas ) {
+	size_t bytes = 0;
+	if ( numReplicas == 0 ) {
+		return 0;
+	}
+	bytes += ARENA_ROUND( numReplicas * sizeof(struct replica) ) + ARENA_ROUND( numReplicas * sizeof(struct worker) );
+	bytes += ARENA_ROUND( numReplicas * sizeof(double) ) + ARENA_ROUND( numReplicas * sizeof(int) ); /* ladder and atRung */
+	bytes += 2 * ARENA_ROUND( numReplicas * sizeof(long int) ); /* swap counts */
+	bytes += 2 * ARENA_ROUND( problem->cols * sizeof(int) ); /* best */
+	bytes += numReplicas * chainBytes( problem );
+	return bytes;
+}
+
+/* Runs the solver's replicas for its number of rounds, then copies the best allocation found into best, along with the moves made by all of them.
+   RETURNS 0, or -1 if a replica found no starting configuration, when best is left alone */
+int parallelTempering( struct solver *solver, struct chain *best ) {
+	struct settings *settings = &solver->settings;
+	int numReplicas = settings->replicas;
+	double minTemp = settings->minTemp, maxTemp = settings->maxTemp;
+	struct arena *arena = &solver->arena;
+	int cols = solver->problem->cols;
+	struct tempering pt;
+	struct worker *workers;
+	struct replica *r;
+	int i, k;
+
+	pt.solver = solver;
+	pt.numReplicas = numReplicas;
+	pt.rounds = settings->rounds;
+	pt.replicas = arenaAlloc( arena, numReplicas * sizeof(struct replica) );
+	pt.ladder = arenaAlloc( arena, numReplicas * sizeof(double) );
+	pt.atRung = arenaAlloc( arena, numReplicas * sizeof(int) );
+	pt.swapsTried = arenaAlloc( arena, numReplicas * sizeof(long int) );
+	pt.swapsMade = arenaAlloc( arena, numReplicas * sizeof(long int) );
+	pt.bestProjNum = arenaAlloc( arena, cols * sizeof(int) );
+	pt.bestProjPref = arenaAlloc( arena, cols * sizeof(int) );
+	pt.bestEnergy = HUGE_VALF; /* scores can be anything, so this is beaten by the first one in, as in multistart.c */
+	pt.best = best;
+	pt.stop = 0;
+	pt.failed = 0;
+	workers = arenaAlloc( arena, numReplicas * sizeof(struct worker) );
+
+	for ( k = 0; k < numReplicas; k++ ) {
+		/* geometric spacing keeps the swap rate roughly the same all the way up */
+		pt.ladder[k] = ( numReplicas == 1 ) ? minTemp : minTemp * pow( maxTemp / minTemp, (double) k / ( numReplicas - 1 ) );
+		pt.atRung[k] = k;
+		pt.swapsTried[k] = 0;
+		pt.swapsMade[k] = 0;
+	}
+	for ( i = 0; i < numReplicas; i++ ) {
+		r = &pt.replicas[i];
+		allocChain( &r->chain, solver, i, arena );
+		r->rung = i;
+	}
+	report( solver, "Parallel tempering: %d replicas from temperature %f to %f, %d rounds\n", numReplicas, minTemp, maxTemp, pt.rounds);
+
+	pthread_barrier_init( &pt.barrier, NULL, numReplicas );
+	for ( i = 0; i < numReplicas; i++ ) {
+		workers[i].pt = &pt;
+		workers[i].id = i;
+		if ( pthread_create( &workers[i].thread, NULL, runReplica, &workers[i] ) != 0 ) {
+			fprintf(stderr, "Could not start thread %d\n", i);
+			exit(1);
+		}
+	}
+	for ( i = 0; i < numReplicas; i++ ) {
+		pthread_join( workers[i].thread, NULL );
+	}
+	pthread_barrier_destroy( &pt.barrier );
+	if ( pt.failed ) {
+		for ( i = 0; i < numReplicas; i++ ) {
+			freeChain( &pt.replicas[i].chain );
+		}
+		return -1;
+	}
+
+	for ( k = 0; k + 1 < numReplicas; k++ ) {
+		report( solver, "Swaps between temperature %f and %f: %ld of %ld\n", pt.ladder[k], pt.ladder[k+1], pt.swapsMade[k], pt.swapsTried[k]);
+	}
+	for ( i = 0; i < cols; i++ ) {
+		best->projNum[i] = pt.bestProjNum[i];
+		best->projPref[i] = pt.bestProjPref[i];
+	}
+	best->currentEnergy = pt.bestEnergy;
+	for ( i = 0; i < numReplicas; i++ ) {
+		best->moves += pt.replicas[i].chain.moves;
+		freeChain( &pt.replicas[i].chain );
+	}
+	return 0;
+}
+
+/* One thread. Makes a starting configuration, then does a cycle of moves at its temperature each round. Between rounds thread 0 does the swaps while the others wait.
+   At the end every replica has a cycle at zero temperature, which takes it to the bottom of whichever minimum it is in.
+   With a time limit, the rounds stop once another one and that last cycle would not be done by then, at the pace of the rounds so far. */
+void *runReplica( void *arg ) {
+	struct worker *worker = arg;
+	struct tempering *pt = worker->pt;
+	struct solver *solver = pt->solver;
+	struct replica *r = &pt->replicas[worker->id];
+	double started, now;
+	int round, k;
+
+	if ( createInitialConfiguration( &r->chain ) != 0 ) {
+		pt->failed = 1;
+	}
+	r->chain.currentEnergy = energy( pt->solver, r->chain.projPref );
+	pthread_barrier_wait( &pt->barrier ); /* so they all know if any failed */
+	if ( pt->failed ) {
+		return NULL;
+	}
+	started = wallTime( solver );
+
+	for ( round = 0; round < pt->rounds; round++ ) {
+		cycleOfMoves( &r->chain, pt->ladder[r->rung] );
+		pthread_barrier_wait( &pt->barrier );
+		if ( worker->id == 0 ) {
+			for ( k = round % 2; k + 1 < pt->numReplicas; k += 2 ) {
+				swapRung( pt, k, &r->chain.rng );
+			}
+			keepBest( pt );
+			if ( ( round + 1 ) % 100 == 0 ) {
+				report( pt->solver, "Round %d\nColdest Energy = %f\nBest Energy = %f\n\n", round + 1, pt->replicas[pt->atRung[0]].chain.currentEnergy, pt->bestEnergy);
+			}
+			now = wallTime( solver );
+			if ( solver->settings.timeLimit > 0 && now + 2 * ( now - started ) / ( round + 1 ) >= solver->settings.timeLimit ) {
+				report( solver, "Out of time after %d rounds\n\n", round + 1 );
+				pt->stop = 1;
+			} else if ( !isnan( solver->settings.targetEnergy ) && pt->bestEnergy <= solver->settings.targetEnergy ) {
+				report( solver, "Reached energy %f after %d rounds\n\n", solver->settings.targetEnergy, round + 1 );
+				solver->targetReached = 1;
+				pt->stop = 1;
+			} else if ( solver->interrupted ) {
+				report( solver, "Interrupted after %d rounds\n\n", round + 1 );
+				pt->stop = 1;
+			}
+		}
+		pthread_barrier_wait( &pt->barrier ); /* nobody starts the next round until the swaps are done */
+		if ( pt->stop ) {
+			break;
+		}
+	}
+
+	cycleOfMoves( &r->chain, 0 );
+	pthread_barrier_wait( &pt->barrier );
+	if ( worker->id == 0 ) {
+		keepBest( pt );
+	}
+	return NULL;
+}
+
+/* The replicas at rungs k and k+1 swap temperatures with probability min(1, exp((1/Tk - 1/Tk+1)(Ek - Ek+1))). */
+void swapRung( struct tempering *pt, int k, struct randStream *rng ) {
+	struct replica *cold = &pt->replicas[pt->atRung[k]];
+	struct replica *hot = &pt->replicas[pt->atRung[k+1]];
+	double delta = ( 1 / pt->ladder[k] - 1 / pt->ladder[k+1] ) * ( cold->chain.currentEnergy - hot->chain.currentEnergy );
+
+	pt->swapsTried[k]++;
+	if ( delta >= 0 || randUniform( rng ) < exp( delta ) ) {
+		pt->atRung[k] = pt->atRung[k+1];
+		pt->atRung[k+1] = cold - pt->replicas;
+		cold->rung = k+1;
+		hot->rung = k;
+		pt->swapsMade[k]++;
+	}
+}
+
+void keepBest( struct tempering *pt ) {
+	struct chain *best = &pt->replicas[0].chain;
+	int i;
+	for ( i = 1; i < pt->numReplicas; i++ ) {
+		if ( pt->replicas[i].chain.currentEnergy < best->currentEnergy ) {
+			best = &pt->replicas[i].chain;
+		}
+	}
+	if ( best->currentEnergy < pt->bestEnergy ) {
+		pt->bestEnergy = best->currentEnergy;
+		noteTarget( pt->best, pt->bestEnergy );
+		for ( i = 0; i < pt->solver->problem->cols; i++ ) {
+			pt->bestProjNum[i] = best->projNum[i];
+			pt->bestProjPref[i] = best->projPref[i];
+		}
+	}
+}